@@ -152,6 +152,31 @@ RTLSDR_API int rtlsdr_set_center_freq(rtlsdr_dev_t *dev, uint32_t freq);
  */
 RTLSDR_API uint32_t rtlsdr_get_center_freq(rtlsdr_dev_t *dev);
 
+/*!
+ * Select when the tuner PLL lock is verified after a retune. By default,
+ * rtlsdr_set_center_freq() reads back the lock status before returning.
+ * In deferred mode the retune only writes the PLL, and the lock is
+ * verified by a later call to rtlsdr_check_pll_lock(), e.g. from a thread
+ * that is not timing critical. Only supported for R820T/R828D tuners.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param deferred 0 to verify synchronously, 1 to defer the check
+ * \return 0 on success, -2 if the tuner doesn't support it
+ */
+RTLSDR_API int rtlsdr_set_pll_lock_check(rtlsdr_dev_t *dev, int deferred);
+
+/*!
+ * Verify the PLL lock of the last retune in deferred mode, see
+ * rtlsdr_set_pll_lock_check(). If the PLL didn't lock, the VCO current is
+ * raised and the lock checked again, as in synchronous mode.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param failures optional, returns the number of retunes that failed to
+ *		   lock since the device has been opened
+ * \return 1 if locked, 0 if not locked, negative on error
+ */
+RTLSDR_API int rtlsdr_check_pll_lock(rtlsdr_dev_t *dev, uint32_t *failures);
+
 /*!
  * Set the frequency correction value for the device.
  *
@@ -215,6 +240,31 @@ RTLSDR_API int rtlsdr_get_tuner_gains(rtlsdr_dev_t *dev, int *gains);
  */
 RTLSDR_API int rtlsdr_set_tuner_gain(rtlsdr_dev_t *dev, int gain);
 
+/*!
+ * Look up the tuner settings for a gain once, so that it can later be
+ * applied with \ref rtlsdr_set_prepared_tuner_gain without searching the
+ * gain table again. On R820T/R828D tuners the prepared gain is written
+ * in a single I2C transfer.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param gain in tenths of a dB, 115 means 11.5 dB.
+ * \param prepared opaque handle for rtlsdr_set_prepared_tuner_gain()
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_prepare_tuner_gain(rtlsdr_dev_t *dev, int gain,
+					 uint32_t *prepared);
+
+/*!
+ * Set a gain prepared with \ref rtlsdr_prepare_tuner_gain.
+ * Manual gain mode must be enabled for this to work.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param prepared handle from rtlsdr_prepare_tuner_gain()
+ * \return 0 on success, -EINVAL if the handle is invalid
+ */
+RTLSDR_API int rtlsdr_set_prepared_tuner_gain(rtlsdr_dev_t *dev,
+					      uint32_t prepared);
+
 /*!
  * Set the bandwidth for the device.
  *
@@ -224,6 +274,34 @@ RTLSDR_API int rtlsdr_set_tuner_gain(rtlsdr_dev_t *dev, int gain);
  */
 RTLSDR_API int rtlsdr_set_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw);
 
+/*!
+ * Compute the tuner filter settings for a bandwidth once, for use with
+ * \ref rtlsdr_set_channel. Up to 8 different bandwidths can be prepared
+ * per device.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param bw bandwidth in Hz. Zero means the current sample rate.
+ * \param prepared opaque handle for rtlsdr_set_channel()
+ * \return 0 on success, -ENOMEM if too many bandwidths are prepared
+ */
+RTLSDR_API int rtlsdr_prepare_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw,
+					      uint32_t *prepared);
+
+/*!
+ * Retune and apply a prepared gain and bandwidth in one step, e.g. when
+ * hopping between channels. On R820T/R828D tuners all register changes
+ * are written together; other tuners fall back to the individual calls.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param freq frequency in Hz the device should be tuned to
+ * \param prepared_gain from rtlsdr_prepare_tuner_gain(), 0 to keep the gain
+ * \param prepared_bw from rtlsdr_prepare_tuner_bandwidth(), 0 to keep the
+ *        bandwidth
+ * \return 0 on success, -EINVAL if a handle is invalid
+ */
+RTLSDR_API int rtlsdr_set_channel(rtlsdr_dev_t *dev, uint32_t freq,
+				  uint32_t prepared_gain, uint32_t prepared_bw);
+
 /*!
  * Get actual gain the device is configured to.
  *
@@ -273,6 +351,41 @@ RTLSDR_API int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t rate);
  */
 RTLSDR_API uint32_t rtlsdr_get_sample_rate(rtlsdr_dev_t *dev);
 
+/*!
+ * Set the sample rate and the center frequency together. The tuner filters
+ * and the resampler are set up first and the tuner is tuned once at the
+ * end, where setting them one by one may retune to the old frequency when
+ * the filters change.
+ *
+ * Steps that would not change anything, like programming the same tuner
+ * bandwidth or resampler ratio again, are skipped here as well as in
+ * rtlsdr_set_sample_rate().
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param rate the sample rate, see rtlsdr_set_sample_rate()
+ * \param freq frequency in Hz the device should be tuned to
+ * \return 0 on success, -EINVAL on invalid rate
+ */
+RTLSDR_API int rtlsdr_set_sample_rate_and_freq(rtlsdr_dev_t *dev,
+					       uint32_t rate, uint32_t freq);
+
+/*!
+ * Program the FIR filter of the RTL2832 demod. It runs at the xtal rate
+ * (28.8 MHz) ahead of the resampler, the default coefficients pass about
+ * +/- 1.2 MHz (-3 dB). A narrower filter reduces aliasing at lower sample
+ * rates, so less filtering is needed on the host.
+ *
+ * The filter is symmetric with 32 taps, coeffs holds the first half. The
+ * chip stores coeffs[0] to coeffs[7] as 8 bit and coeffs[8] to coeffs[15]
+ * as 12 bit signed values, the coefficients should add up to about 2048
+ * for unity gain. The coefficients are kept for reconnects.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param coeffs 16 coefficients, NULL restores the default filter
+ * \return 0 on success, -EINVAL if a coefficient is out of range
+ */
+RTLSDR_API int rtlsdr_set_fir_coeffs(rtlsdr_dev_t *dev, const int16_t *coeffs);
+
 /*!
  * Enable test mode that returns an 8 bit counter instead of the samples.
  * The counter is generated inside the RTL2832.
@@ -360,10 +473,12 @@ RTLSDR_API int rtlsdr_wait_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, v
  * \param cb callback function to return received samples
  * \param ctx user specific context to pass via the callback function
  * \param buf_num optional buffer count, buf_num * buf_len = overall buffer size
- *		  set to 0 for default buffer count (15)
+ *		  set to 0 for default buffer count (15), or the count
+ *		  derived from the latency target if one is set
  * \param buf_len optional buffer length, must be multiple of 512,
  *		  should be a multiple of 16384 (URB size), set to 0
- *		  for default buffer length (16 * 32 * 512)
+ *		  for default buffer length (16 * 32 * 512), or the length
+ *		  derived from the latency target if one is set
  * \return 0 on success
  */
 RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
@@ -372,6 +487,60 @@ RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
 				 uint32_t buf_num,
 				 uint32_t buf_len);
 
+/*!
+ * Set the target latency of the asynchronous sample pipeline. Buffer count
+ * and length that are passed as 0 to rtlsdr_read_async() are then derived
+ * from the target and the sample rate at the time streaming starts, instead
+ * of using the defaults. Lengths are multiples of 512 bytes, the overall
+ * size is kept within the default usbfs memory limit.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param usec latency in microseconds, 0 restores the default buffering
+ * \return negative on error, otherwise the resulting pipeline delay in
+ *	    microseconds at the current sample rate
+ */
+RTLSDR_API int rtlsdr_set_latency_target(rtlsdr_dev_t *dev, uint32_t usec);
+
+/*!
+ * Get the buffer configuration rtlsdr_read_async() will use for the current
+ * latency target and sample rate.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param buf_num returns the buffer count
+ * \param buf_len buffer length, if non-zero on input it is kept and only
+ *		  the count is derived from the target, must be a multiple
+ *		  of 512
+ * \return negative on error, otherwise the pipeline delay in microseconds,
+ *	    i.e. the age of the oldest samples when a buffer is delivered
+ */
+RTLSDR_API int rtlsdr_get_latency_buffers(rtlsdr_dev_t *dev,
+					  uint32_t *buf_num,
+					  uint32_t *buf_len);
+
+/*!
+ * Enable or disable zero-copy buffers for asynchronous streaming. When
+ * enabled (the default on Linux with libusb >= 1.0.21), the transfer
+ * buffers are mapped from usbfs so the kernel does not copy the samples.
+ * The buffers are probed when streaming starts, and the library falls back
+ * to userspace buffers if the mapping fails or is broken. The environment
+ * variable RTLSDR_ZEROCOPY=0 disables zero-copy when the device is opened.
+ *
+ * The setting takes effect the next time streaming is started.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param on 0 means disabled, 1 enabled
+ * \return 0 on success, -2 if zero-copy is not supported by this build
+ */
+RTLSDR_API int rtlsdr_set_zerocopy(rtlsdr_dev_t *dev, int on);
+
+/*!
+ * Get the buffer mode used by the current, or last, asynchronous stream.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \return -1 on error, 0 means userspace buffers, 1 zero-copy buffers
+ */
+RTLSDR_API int rtlsdr_get_zerocopy(rtlsdr_dev_t *dev);
+
 /*!
  * Cancel all pending asynchronous operations on the device.
  *
@@ -380,6 +549,94 @@ RTLSDR_API int rtlsdr_read_async(rtlsdr_dev_t *dev,
  */
 RTLSDR_API int rtlsdr_cancel_async(rtlsdr_dev_t *dev);
 
+/*!
+ * Enable or disable automatic reconnection. When enabled and the device is
+ * lost while streaming, rtlsdr_read_async() does not return but waits for
+ * a device with the same serial number to show up again, restores the
+ * frequency, sample rate, bandwidth, gain, frequency correction and bias
+ * tee settings and resumes streaming with the same callback.
+ *
+ * If the device is not back within the reconnect timeout (30 s by default,
+ * see rtlsdr_set_reconnect_timeout()), rtlsdr_read_async() returns -1.
+ *
+ * Each reconnect is a stream discontinuity, see rtlsdr_get_discontinuities().
+ * For testing, the environment variable RTLSDR_SIMULATE_LOSS=n makes the
+ * library handle every n-th completed transfer as if the device was lost.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param on 0 means disabled, 1 enabled
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_auto_reconnect(rtlsdr_dev_t *dev, int on);
+
+/*!
+ * Set how long an automatic reconnect waits for the lost device to show up
+ * again. Control calls from other threads block for as long, since they
+ * wait for the reconnect to finish.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param ms timeout in milliseconds, 0 waits until rtlsdr_cancel_async()
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_set_reconnect_timeout(rtlsdr_dev_t *dev, uint32_t ms);
+
+/*!
+ * Tune to a frequency and read a burst of samples, for scanning
+ * applications. The first call starts streaming into a small set of bulk
+ * transfers that stay queued between calls, so no setup round-trips are
+ * needed per burst. After a retune, the data that was in flight at that
+ * time and the given number of settling samples are dropped inside the
+ * library. If the frequency is unchanged nothing is dropped, but bursts
+ * are not contiguous: the transfers are only serviced during a call, so a
+ * burst starts with whatever they held from before the call (at most the
+ * buffer count times the buffer length) and samples older than that are
+ * lost without notice.
+ *
+ * The device stays in burst mode until it is closed or a burst fails,
+ * rtlsdr_read_sync() and rtlsdr_read_async() return -2 meanwhile. With
+ * rtlsdr_set_auto_reconnect() a lost device is reconnected and the burst
+ * is captured again. The buffer sizes follow the latency target, if set
+ * with rtlsdr_set_latency_target().
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param freq frequency in Hz to capture at
+ * \param skip_samples number of samples to drop after a retune
+ * \param buf buffer for 2 * n_samples bytes of interleaved I/Q data
+ * \param n_samples number of samples to read
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_capture_burst(rtlsdr_dev_t *dev, uint32_t freq,
+				    uint32_t skip_samples, uint8_t *buf,
+				    uint32_t n_samples);
+
+/*!
+ * Get the number of stream discontinuities caused by reconnects. The count
+ * is updated before the first buffer after a reconnect is passed to the
+ * callback, so it may be polled from within the callback.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param gap_ms optional, returns the duration of the last gap in ms
+ * \return number of discontinuities since the device has been opened
+ */
+RTLSDR_API uint32_t rtlsdr_get_discontinuities(rtlsdr_dev_t *dev,
+					       uint32_t *gap_ms);
+
+/*!
+ * Get the time the steps of rtlsdr_open() took for this device. The R82xx
+ * IF filter calibration is part of the tuner init on open only, re-inits
+ * after a reconnect or leaving direct sampling reuse its result.
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param usb_us optional, returns the time to open the USB device in us
+ * \param baseband_us optional, returns the baseband init time in us
+ * \param probe_us optional, returns the tuner probing time in us
+ * \param tuner_us optional, returns the tuner init time in us
+ * \return -1 if device is not initialized. 0 otherwise.
+ */
+RTLSDR_API int rtlsdr_get_open_timing(rtlsdr_dev_t *dev, uint32_t *usb_us,
+				      uint32_t *baseband_us, uint32_t *probe_us,
+				      uint32_t *tuner_us);
+
 /*!
  * Enable or disable the bias tee on GPIO PIN 0.
  *
@@ -399,6 +656,81 @@ RTLSDR_API int rtlsdr_set_bias_tee(rtlsdr_dev_t *dev, int on);
  */
 RTLSDR_API int rtlsdr_set_bias_tee_gpio(rtlsdr_dev_t *dev, int gpio, int on);
 
+/* device groups */
+
+typedef struct rtlsdr_group rtlsdr_group_t;
+
+typedef struct rtlsdr_stream_info {
+	uint64_t sample;	  /* index of the first I/Q sample in the buffer */
+	uint64_t host_ns;	  /* monotonic host time the buffer arrived, ns */
+	uint32_t discontinuities; /* see rtlsdr_get_discontinuities() */
+} rtlsdr_stream_info_t;
+
+typedef void(*rtlsdr_group_cb_t)(rtlsdr_dev_t *dev, unsigned char *buf,
+				 uint32_t len,
+				 const rtlsdr_stream_info_t *info,
+				 void *ctx);
+
+/*!
+ * Create a device group. The devices of a group share one libusb context
+ * and are streamed from a single event loop, see rtlsdr_group_read_async().
+ *
+ * \param grp returns the group handle
+ * \return 0 on success
+ */
+RTLSDR_API int rtlsdr_group_create(rtlsdr_group_t **grp);
+
+/*!
+ * Open a device as a member of a group. The handle can be configured and
+ * closed like one returned by rtlsdr_open(), rtlsdr_close() removes it from
+ * the group.
+ *
+ * \param grp the group handle given by rtlsdr_group_create()
+ * \param dev returns the device handle
+ * \param index the device index, as for rtlsdr_open()
+ * \param cb callback to pass the samples of this device to
+ * \param ctx user specific context to pass via the callback function
+ * \return 0 on success, -2 while the group is streaming
+ */
+RTLSDR_API int rtlsdr_group_open(rtlsdr_group_t *grp, rtlsdr_dev_t **dev,
+				 uint32_t index, rtlsdr_group_cb_t cb,
+				 void *ctx);
+
+/*!
+ * Stream all devices of the group from the calling thread. This function
+ * blocks until rtlsdr_group_cancel_async() is called, or until every device
+ * has stopped. A device that is lost or canceled with rtlsdr_cancel_async()
+ * stops streaming while the others continue; devices in a group are not
+ * reconnected automatically.
+ *
+ * The host timestamps of all devices come from the same monotonic clock,
+ * so buffers of different devices can be related to each other.
+ *
+ * \param grp the group handle given by rtlsdr_group_create()
+ * \param buf_num buffer count per device, as for rtlsdr_read_async()
+ * \param buf_len buffer length, as for rtlsdr_read_async()
+ * \return 0 on success, -2 if the group or one of its devices is streaming
+ */
+RTLSDR_API int rtlsdr_group_read_async(rtlsdr_group_t *grp,
+				       uint32_t buf_num,
+				       uint32_t buf_len);
+
+/*!
+ * Stop streaming all devices of the group.
+ *
+ * \param grp the group handle given by rtlsdr_group_create()
+ * \return 0 on success, -2 if the group is not streaming
+ */
+RTLSDR_API int rtlsdr_group_cancel_async(rtlsdr_group_t *grp);
+
+/*!
+ * Close all devices remaining in the group and free the group.
+ *
+ * \param grp the group handle given by rtlsdr_group_create()
+ * \return 0 on success, -2 while the group is streaming
+ */
+RTLSDR_API int rtlsdr_group_destroy(rtlsdr_group_t *grp);
+
 
 #ifdef __cplusplus
 }
@@ -190,12 +190,30 @@ struct e4k_pll_params {
 	uint8_t threephase;
 };
 
+#define E4K_NUM_REGS		0x80
+#define E4K_TUNE_CACHE_SIZE	4
+
+/* PLL, band and RF filter settings for one frequency */
+struct e4k_tune_entry {
+	struct e4k_pll_params p;	/* p.fosc 0: unused entry */
+	enum e4k_band band;
+	uint8_t rf_filter;
+};
+
 struct e4k_state {
 	void *i2c_dev;
 	uint8_t i2c_addr;
 	enum e4k_band band;
 	struct e4k_pll_params vco;
 	void *rtl_dev;
+
+	/* register values last written by the driver */
+	uint8_t regs[E4K_NUM_REGS];
+	uint8_t regs_valid[E4K_NUM_REGS / 8];
+
+	/* recently tuned frequencies, see e4k_tune_freq() */
+	struct e4k_tune_entry tune_cache[E4K_TUNE_CACHE_SIZE];
+	unsigned int tune_cache_next;
 };
 
 int e4k_init(struct e4k_state *e4k);
@@ -41,6 +41,8 @@
 
 #define VER_NUM			49
 
+#define R82XX_GAIN_STEPS	31
+
 enum r82xx_chip {
 	CHIP_R820T,
 	CHIP_R620D,
@@ -70,6 +72,18 @@ struct r82xx_config {
 	enum r82xx_chip rafael_chip;
 	unsigned int max_i2c_msg_len;
 	int use_predetect;
+	int blog_v4;	/* RTL-SDR Blog V4, resolved when opening */
+};
+
+struct r82xx_gain_step {
+	int		gain;	/* tenth dB */
+	uint8_t		index;	/* mixer index << 4 | LNA index */
+};
+
+struct r82xx_bw_setting {
+	uint8_t		reg_0a;
+	uint8_t		reg_0b;
+	uint32_t	int_freq;	/* Hz */
 };
 
 struct r82xx_priv {
@@ -81,10 +95,29 @@ struct r82xx_priv {
 	uint16_t			pll;	/* kHz */
 	uint32_t			int_freq;
 	uint8_t				fil_cal_code;
+	int				fil_cal_valid;	/* kept across r82xx_init() */
 	uint8_t				input;
 	int				has_lock;
 	int				init_done;
 
+	/* Last mux and Blog V4 input settings, -1/0xff: unknown */
+	int				mux_range;
+	enum r82xx_xtal_cap_value	mux_xtal_cap;
+	int				notch;
+
+	/* Deferred PLL lock check, see r82xx_check_lock() */
+	int				lock_deferred;
+	int				lock_pending;
+	unsigned int			lock_failures;
+	int				vco_fine_tune;	/* -1: unknown */
+
+	/* Manual gain settings, in the order r82xx_set_gain() tries them */
+	struct r82xx_gain_step		gain_steps[R82XX_GAIN_STEPS];
+
+	/* Staged register writes, see r82xx_flush() */
+	int				staging;
+	uint32_t			dirty;	/* bit n: shadow register n */
+
 	/* Store current mode */
 	uint32_t			delsys;
 	enum r82xx_tuner_type		type;
@@ -115,6 +148,14 @@ int r82xx_standby(struct r82xx_priv *priv);
 int r82xx_init(struct r82xx_priv *priv);
 int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq);
 int r82xx_set_gain(struct r82xx_priv *priv, int set_manual_gain, int gain);
+uint8_t r82xx_gain_index(struct r82xx_priv *priv, int gain);
+int r82xx_set_gain_index(struct r82xx_priv *priv, uint8_t index);
+void r82xx_prepare_bandwidth(int bw, struct r82xx_bw_setting *setting);
+int r82xx_set_prepared_bandwidth(struct r82xx_priv *priv,
+				 const struct r82xx_bw_setting *setting);
+int r82xx_set_channel(struct r82xx_priv *priv, uint32_t freq,
+		      const struct r82xx_bw_setting *bw, int gain_index);
 int r82xx_set_bandwidth(struct r82xx_priv *priv, int bandwidth,  uint32_t rate);
+int r82xx_check_lock(struct r82xx_priv *priv);
 
 #endif
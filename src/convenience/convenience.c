@@ -164,6 +164,20 @@ int verbose_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 	return r;
 }
 
+int verbose_set_sample_rate_and_frequency(rtlsdr_dev_t *dev, uint32_t samp_rate,
+					  uint32_t frequency)
+{
+	int r;
+	r = rtlsdr_set_sample_rate_and_freq(dev, samp_rate, frequency);
+	if (r < 0) {
+		fprintf(stderr, "WARNING: Failed to set sample rate and center freq.\n");
+	} else {
+		fprintf(stderr, "Sampling at %u S/s.\n", samp_rate);
+		fprintf(stderr, "Tuned to %u Hz.\n", frequency);
+	}
+	return r;
+}
+
 int verbose_direct_sampling(rtlsdr_dev_t *dev, int on)
 {
 	int r;
@@ -236,6 +250,47 @@ int verbose_ppm_set(rtlsdr_dev_t *dev, int ppm_error)
 	return r;
 }
 
+/*
+ * Demod FIR profiles, first half of the symmetric 32 tap filter at 28.8 MHz.
+ * Equiripple designs, passband edge / -3 dB / stopband edge and attenuation:
+ *  wide:   1.3 / 1.65 / 2.5 MHz, 32 dB, for 2.4 - 3.2 MS/s
+ *  narrow: 0.5 / 0.6 / 1.55 MHz, 31 dB, for 0.5 MHz of signal at 2.048 MS/s
+ */
+static const struct {
+	const char *name;
+	int16_t coeffs[16];
+} fir_profiles[] = {
+	{ "default", { -54, -36, -41, -40, -32, -14, 14, 53,
+		       101, 156, 215, 273, 327, 372, 404, 421 } },
+	{ "wide", { 15, -61, -63, -78, -89, -89, -72, -35,
+		    23, 99, 190, 287, 381, 462, 523, 555 } },
+	{ "narrow", { -33, 42, 42, 51, 66, 83, 102, 121,
+		      142, 161, 180, 196, 211, 222, 230, 233 } },
+};
+
+int verbose_set_fir_profile(rtlsdr_dev_t *dev, const char *name)
+{
+	unsigned int i;
+	int r;
+
+	for (i = 0; i < sizeof(fir_profiles) / sizeof(fir_profiles[0]); i++) {
+		if (!strcmp(fir_profiles[i].name, name))
+			break;
+	}
+	if (i == sizeof(fir_profiles) / sizeof(fir_profiles[0])) {
+		fprintf(stderr, "WARNING: Unknown FIR profile %s.\n", name);
+		return -1;
+	}
+
+	r = rtlsdr_set_fir_coeffs(dev, fir_profiles[i].coeffs);
+	if (r < 0) {
+		fprintf(stderr, "WARNING: Failed to set FIR profile.\n");
+	} else {
+		fprintf(stderr, "Demod FIR profile set to %s.\n", name);
+	}
+	return r;
+}
+
 int verbose_reset_buffer(rtlsdr_dev_t *dev)
 {
 	int r;
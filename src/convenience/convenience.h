@@ -74,6 +74,18 @@ int verbose_set_frequency(rtlsdr_dev_t *dev, uint32_t frequency);
 
 int verbose_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate);
 
+/*!
+ * Set device sample rate and frequency in one go and report status on stderr
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param samp_rate in samples/second
+ * \param frequency in Hz
+ * \return 0 on success
+ */
+
+int verbose_set_sample_rate_and_frequency(rtlsdr_dev_t *dev, uint32_t samp_rate,
+					  uint32_t frequency);
+
 /*!
  * Enable or disable the direct sampling mode and report status on stderr
  *
@@ -122,6 +134,16 @@ int verbose_gain_set(rtlsdr_dev_t *dev, int gain);
 
 int verbose_ppm_set(rtlsdr_dev_t *dev, int ppm_error);
 
+/*!
+ * Program one of the built-in demod FIR profiles and report status on stderr
+ *
+ * \param dev the device handle given by rtlsdr_open()
+ * \param name "default", "wide" (2.4 - 3.2 MS/s) or "narrow" (+/- 0.5 MHz)
+ * \return 0 on success
+ */
+
+int verbose_set_fir_profile(rtlsdr_dev_t *dev, const char *name);
+
 /*!
  * Reset buffer
  *
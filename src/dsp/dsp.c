@@ -0,0 +1,464 @@
+/*
+ * Copyright (C) 2014 by Kyle Keen <keenerd@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* integer decimation shared by rtl_fm and rtl_power
+ *
+ * The vector kernels work on a tile of even and odd complex samples
+ * split into two scratch arrays, with the pass history in front of
+ * them.  Each complex sample is an I/Q pair of int16, and the
+ * multiply-accumulates pair an int16 from each of two arrays, which
+ * keeps I and Q in their own lanes without a deinterleave.
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "dsp.h"
+
+#define CIC_TILE		256	/* complex outputs per scratch tile */
+
+/* {length, coef, coef, coef}  and scaled by 2^15
+   for now, only length 9, optimal way to get +85% bandwidth
+   the center tap is always above 2^15, the vector code relies on it */
+static const int cic_9_tables[DSP_CIC_MAX_PASSES+1][10] = {
+	{0,},
+	{9, -156,  -97, 2798, -15489, 61019, -15489, 2798,  -97, -156},
+	{9, -128, -568, 5593, -24125, 74126, -24125, 5593, -568, -128},
+	{9, -129, -639, 6187, -26281, 77511, -26281, 6187, -639, -129},
+	{9, -122, -612, 6082, -26353, 77818, -26353, 6082, -612, -122},
+	{9, -120, -602, 6015, -26269, 77757, -26269, 6015, -602, -120},
+	{9, -120, -582, 5951, -26128, 77542, -26128, 5951, -582, -120},
+	{9, -119, -580, 5931, -26094, 77505, -26094, 5931, -580, -119},
+	{9, -119, -578, 5921, -26077, 77484, -26077, 5921, -578, -119},
+	{9, -119, -577, 5917, -26067, 77473, -26067, 5917, -577, -119},
+	{9, -199, -362, 5303, -25505, 77489, -25505, 5303, -362, -199},
+};
+
+static int16_t clamp16(int32_t x)
+{
+	if (x > 32767) {
+		return 32767;}
+	if (x < -32768) {
+		return -32768;}
+	return (int16_t)x;
+}
+
+int dsp_cic_init(struct dsp_cic *c, int passes, int comp)
+{
+	if (passes < 1 || passes > DSP_CIC_MAX_PASSES) {
+		return -EINVAL;}
+	memset(c, 0, sizeof(struct dsp_cic));
+	c->passes = passes;
+	c->comp = comp;
+	return 0;
+}
+
+/* reference versions, one rolling window per channel */
+
+static void cic_pass_ref(int16_t *hist, int16_t *iq, int n)
+/* n complex samples in, n/2 out */
+{
+	int m, ch;
+	int32_t a, b, c, d, e, f;
+	for (ch=0; ch<2; ch++) {
+		a = hist[ch];
+		b = hist[2+ch];
+		c = hist[4+ch];
+		d = hist[6+ch];
+		e = hist[8+ch];
+		for (m=0; m < n/2; m++) {
+			f = iq[4*m+ch];
+			/* a downsample should improve resolution, so don't fully shift */
+			iq[2*m+ch] = clamp16((a + (b+e)*5 + (c+d)*10 + f) >> 4);
+			a = c;
+			b = d;
+			c = e;
+			d = f;
+			e = iq[4*m+2+ch];
+		}
+		hist[ch] = (int16_t)a;
+		hist[2+ch] = (int16_t)b;
+		hist[4+ch] = (int16_t)c;
+		hist[6+ch] = (int16_t)d;
+		hist[8+ch] = (int16_t)e;
+	}
+}
+
+static int16_t droop_one(const int16_t *h, const int *fir)
+/* h holds 9 samples of one channel at stride 2, oldest first */
+{
+	uint32_t sum;
+	/* wraps like the vector code does */
+	sum  = (uint32_t)(h[0] + h[16]) * (uint32_t)fir[1];
+	sum += (uint32_t)(h[2] + h[14]) * (uint32_t)fir[2];
+	sum += (uint32_t)(h[4] + h[12]) * (uint32_t)fir[3];
+	sum += (uint32_t)(h[6] + h[10]) * (uint32_t)fir[4];
+	sum += (uint32_t)h[8] * (uint32_t)fir[5];
+	return clamp16((int32_t)sum >> 15);
+}
+
+static void droop_ref(int16_t *hist, int16_t *iq, int n, const int *fir)
+/* 9 taps, symmetric, one sample of delay */
+{
+	int i, k, ch;
+	int16_t temp;
+	for (i=0; i<n; i++) {
+		for (ch=0; ch<2; ch++) {
+			temp = iq[2*i+ch];
+			iq[2*i+ch] = droop_one(hist + ch, fir);
+			for (k=ch; k<16; k+=2) {
+				hist[k] = hist[k+2];}
+			hist[16+ch] = temp;
+		}
+	}
+}
+
+int dsp_cic_decimate_ref(struct dsp_cic *c, int16_t *iq, int len)
+{
+	int i, n = len / 2;
+	for (i=0; i < c->passes; i++) {
+		cic_pass_ref(c->hist[i], iq, n);
+		n /= 2;
+	}
+	if (c->comp) {
+		droop_ref(c->droop, iq, n, cic_9_tables[c->passes]);}
+	return n * 2;
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+/* vector kernels, each returns how many complex outputs it wrote */
+
+static int cic_kernel(const int16_t *ev, const int16_t *od, int16_t *out, int cnt)
+/* out[k] = ev[k+2] + 10ev[k+1] + 5ev[k] + 5od[k+2] + 10od[k+1] + od[k] */
+{
+	int k = 0;
+#if defined(__AVX2__)
+	__m256i c1_10 = _mm256_set1_epi32((10 << 16) | 1);
+	__m256i c5_5  = _mm256_set1_epi32((5 << 16) | 5);
+	__m256i c10_1 = _mm256_set1_epi32((1 << 16) | 10);
+	__m256i e0, e1, e2, o0, o1, o2, lo, hi;
+	for (; k + 8 <= cnt; k += 8) {
+		e0 = _mm256_loadu_si256((const __m256i *)(ev + 2*k + 4));
+		e1 = _mm256_loadu_si256((const __m256i *)(ev + 2*k + 2));
+		e2 = _mm256_loadu_si256((const __m256i *)(ev + 2*k));
+		o0 = _mm256_loadu_si256((const __m256i *)(od + 2*k + 4));
+		o1 = _mm256_loadu_si256((const __m256i *)(od + 2*k + 2));
+		o2 = _mm256_loadu_si256((const __m256i *)(od + 2*k));
+		lo = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(e0, e1), c1_10),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(e2, o0), c5_5));
+		lo = _mm256_add_epi32(lo,
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(o1, o2), c10_1));
+		hi = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(e0, e1), c1_10),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(e2, o0), c5_5));
+		hi = _mm256_add_epi32(hi,
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(o1, o2), c10_1));
+		/* unpack and pack are both per 128 bit lane, so order survives */
+		_mm256_storeu_si256((__m256i *)(out + 2*k), _mm256_packs_epi32(
+			_mm256_srai_epi32(lo, 4), _mm256_srai_epi32(hi, 4)));
+	}
+#elif defined(__SSE2__)
+	__m128i c1_10 = _mm_set1_epi32((10 << 16) | 1);
+	__m128i c5_5  = _mm_set1_epi32((5 << 16) | 5);
+	__m128i c10_1 = _mm_set1_epi32((1 << 16) | 10);
+	__m128i e0, e1, e2, o0, o1, o2, lo, hi;
+	for (; k + 4 <= cnt; k += 4) {
+		e0 = _mm_loadu_si128((const __m128i *)(ev + 2*k + 4));
+		e1 = _mm_loadu_si128((const __m128i *)(ev + 2*k + 2));
+		e2 = _mm_loadu_si128((const __m128i *)(ev + 2*k));
+		o0 = _mm_loadu_si128((const __m128i *)(od + 2*k + 4));
+		o1 = _mm_loadu_si128((const __m128i *)(od + 2*k + 2));
+		o2 = _mm_loadu_si128((const __m128i *)(od + 2*k));
+		lo = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi16(e0, e1), c1_10),
+			_mm_madd_epi16(_mm_unpacklo_epi16(e2, o0), c5_5));
+		lo = _mm_add_epi32(lo,
+			_mm_madd_epi16(_mm_unpacklo_epi16(o1, o2), c10_1));
+		hi = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpackhi_epi16(e0, e1), c1_10),
+			_mm_madd_epi16(_mm_unpackhi_epi16(e2, o0), c5_5));
+		hi = _mm_add_epi32(hi,
+			_mm_madd_epi16(_mm_unpackhi_epi16(o1, o2), c10_1));
+		_mm_storeu_si128((__m128i *)(out + 2*k), _mm_packs_epi32(
+			_mm_srai_epi32(lo, 4), _mm_srai_epi32(hi, 4)));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	int16x8_t e0, e1, e2, o0, o1, o2;
+	int32x4_t lo, hi;
+	for (; k + 4 <= cnt; k += 4) {
+		e0 = vld1q_s16(ev + 2*k + 4);
+		e1 = vld1q_s16(ev + 2*k + 2);
+		e2 = vld1q_s16(ev + 2*k);
+		o0 = vld1q_s16(od + 2*k + 4);
+		o1 = vld1q_s16(od + 2*k + 2);
+		o2 = vld1q_s16(od + 2*k);
+		lo = vmovl_s16(vget_low_s16(e0));
+		lo = vmlal_n_s16(lo, vget_low_s16(e1), 10);
+		lo = vmlal_n_s16(lo, vget_low_s16(e2), 5);
+		lo = vmlal_n_s16(lo, vget_low_s16(o0), 5);
+		lo = vmlal_n_s16(lo, vget_low_s16(o1), 10);
+		lo = vaddw_s16(lo, vget_low_s16(o2));
+		hi = vmovl_s16(vget_high_s16(e0));
+		hi = vmlal_n_s16(hi, vget_high_s16(e1), 10);
+		hi = vmlal_n_s16(hi, vget_high_s16(e2), 5);
+		hi = vmlal_n_s16(hi, vget_high_s16(o0), 5);
+		hi = vmlal_n_s16(hi, vget_high_s16(o1), 10);
+		hi = vaddw_s16(hi, vget_high_s16(o2));
+		vst1q_s16(out + 2*k, vcombine_s16(vqshrn_n_s32(lo, 4), vqshrn_n_s32(hi, 4)));
+	}
+#endif
+	return k;
+}
+
+static int droop_kernel(const int16_t *x, int16_t *out, int cnt, const int *fir)
+/* out[k] from x[k..k+8], the center tap split as (f5 - 2^16) + 2^16 */
+{
+	int k = 0;
+#if defined(__AVX2__)
+	__m256i zero = _mm256_setzero_si256();
+	__m256i f1 = _mm256_set1_epi16((int16_t)fir[1]);
+	__m256i f2 = _mm256_set1_epi16((int16_t)fir[2]);
+	__m256i f3 = _mm256_set1_epi16((int16_t)fir[3]);
+	__m256i f4 = _mm256_set1_epi16((int16_t)fir[4]);
+	__m256i f5 = _mm256_set1_epi32((int16_t)(fir[5] - 65536) & 0xffff);
+	__m256i x0, x1, x2, x3, x4, x5, x6, x7, x8, lo, hi;
+	for (; k + 8 <= cnt; k += 8) {
+		x0 = _mm256_loadu_si256((const __m256i *)(x + 2*k));
+		x1 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 2));
+		x2 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 4));
+		x3 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 6));
+		x4 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 8));
+		x5 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 10));
+		x6 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 12));
+		x7 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 14));
+		x8 = _mm256_loadu_si256((const __m256i *)(x + 2*k + 16));
+		lo = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(x0, x8), f1),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(x1, x7), f2));
+		lo = _mm256_add_epi32(lo, _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(x2, x6), f3),
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(x3, x5), f4)));
+		lo = _mm256_add_epi32(lo, _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi16(x4, zero), f5),
+			_mm256_unpacklo_epi16(zero, x4)));
+		hi = _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(x0, x8), f1),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(x1, x7), f2));
+		hi = _mm256_add_epi32(hi, _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(x2, x6), f3),
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(x3, x5), f4)));
+		hi = _mm256_add_epi32(hi, _mm256_add_epi32(
+			_mm256_madd_epi16(_mm256_unpackhi_epi16(x4, zero), f5),
+			_mm256_unpackhi_epi16(zero, x4)));
+		_mm256_storeu_si256((__m256i *)(out + 2*k), _mm256_packs_epi32(
+			_mm256_srai_epi32(lo, 15), _mm256_srai_epi32(hi, 15)));
+	}
+#elif defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i f1 = _mm_set1_epi16((int16_t)fir[1]);
+	__m128i f2 = _mm_set1_epi16((int16_t)fir[2]);
+	__m128i f3 = _mm_set1_epi16((int16_t)fir[3]);
+	__m128i f4 = _mm_set1_epi16((int16_t)fir[4]);
+	__m128i f5 = _mm_set1_epi32((int16_t)(fir[5] - 65536) & 0xffff);
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, lo, hi;
+	for (; k + 4 <= cnt; k += 4) {
+		x0 = _mm_loadu_si128((const __m128i *)(x + 2*k));
+		x1 = _mm_loadu_si128((const __m128i *)(x + 2*k + 2));
+		x2 = _mm_loadu_si128((const __m128i *)(x + 2*k + 4));
+		x3 = _mm_loadu_si128((const __m128i *)(x + 2*k + 6));
+		x4 = _mm_loadu_si128((const __m128i *)(x + 2*k + 8));
+		x5 = _mm_loadu_si128((const __m128i *)(x + 2*k + 10));
+		x6 = _mm_loadu_si128((const __m128i *)(x + 2*k + 12));
+		x7 = _mm_loadu_si128((const __m128i *)(x + 2*k + 14));
+		x8 = _mm_loadu_si128((const __m128i *)(x + 2*k + 16));
+		lo = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi16(x0, x8), f1),
+			_mm_madd_epi16(_mm_unpacklo_epi16(x1, x7), f2));
+		lo = _mm_add_epi32(lo, _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi16(x2, x6), f3),
+			_mm_madd_epi16(_mm_unpacklo_epi16(x3, x5), f4)));
+		lo = _mm_add_epi32(lo, _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpacklo_epi16(x4, zero), f5),
+			_mm_unpacklo_epi16(zero, x4)));
+		hi = _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpackhi_epi16(x0, x8), f1),
+			_mm_madd_epi16(_mm_unpackhi_epi16(x1, x7), f2));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpackhi_epi16(x2, x6), f3),
+			_mm_madd_epi16(_mm_unpackhi_epi16(x3, x5), f4)));
+		hi = _mm_add_epi32(hi, _mm_add_epi32(
+			_mm_madd_epi16(_mm_unpackhi_epi16(x4, zero), f5),
+			_mm_unpackhi_epi16(zero, x4)));
+		_mm_storeu_si128((__m128i *)(out + 2*k), _mm_packs_epi32(
+			_mm_srai_epi32(lo, 15), _mm_srai_epi32(hi, 15)));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	int16x8_t x0, x1, x2, x3, x4, x5, x6, x7, x8;
+	int32x4_t lo, hi;
+	for (; k + 4 <= cnt; k += 4) {
+		x0 = vld1q_s16(x + 2*k);
+		x1 = vld1q_s16(x + 2*k + 2);
+		x2 = vld1q_s16(x + 2*k + 4);
+		x3 = vld1q_s16(x + 2*k + 6);
+		x4 = vld1q_s16(x + 2*k + 8);
+		x5 = vld1q_s16(x + 2*k + 10);
+		x6 = vld1q_s16(x + 2*k + 12);
+		x7 = vld1q_s16(x + 2*k + 14);
+		x8 = vld1q_s16(x + 2*k + 16);
+		lo = vmulq_n_s32(vmovl_s16(vget_low_s16(x4)), fir[5]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x0), (int16_t)fir[1]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x8), (int16_t)fir[1]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x1), (int16_t)fir[2]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x7), (int16_t)fir[2]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x2), (int16_t)fir[3]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x6), (int16_t)fir[3]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x3), (int16_t)fir[4]);
+		lo = vmlal_n_s16(lo, vget_low_s16(x5), (int16_t)fir[4]);
+		hi = vmulq_n_s32(vmovl_s16(vget_high_s16(x4)), fir[5]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x0), (int16_t)fir[1]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x8), (int16_t)fir[1]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x1), (int16_t)fir[2]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x7), (int16_t)fir[2]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x2), (int16_t)fir[3]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x6), (int16_t)fir[3]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x3), (int16_t)fir[4]);
+		hi = vmlal_n_s16(hi, vget_high_s16(x5), (int16_t)fir[4]);
+		vst1q_s16(out + 2*k, vcombine_s16(vqshrn_n_s32(lo, 15), vqshrn_n_s32(hi, 15)));
+	}
+#endif
+	return k;
+}
+
+static int split_even_odd(const int16_t *iq, int16_t *ev, int16_t *od, int cnt)
+/* cnt pairs of complex samples to ev and od, returns how many were done */
+{
+	int k = 0;
+#if defined(__SSE2__)
+	__m128 a, b;
+	for (; k + 4 <= cnt; k += 4) {
+		a = _mm_loadu_ps((const float *)(iq + 4*k));
+		b = _mm_loadu_ps((const float *)(iq + 4*k + 8));
+		/* one complex int16 sample is 32 bits, shuffle it as a float */
+		_mm_storeu_ps((float *)(ev + 2*k), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+		_mm_storeu_ps((float *)(od + 2*k), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	int32x4x2_t v;
+	for (; k + 4 <= cnt; k += 4) {
+		v = vld2q_s32((const int32_t *)(iq + 4*k));
+		vst1q_s32((int32_t *)(ev + 2*k), v.val[0]);
+		vst1q_s32((int32_t *)(od + 2*k), v.val[1]);
+	}
+#endif
+	return k;
+}
+
+static void cic_pass(int16_t *hist, int16_t *iq, int n)
+/* n complex samples in, n/2 out */
+{
+	int16_t ev[2*(CIC_TILE+2)];
+	int16_t od[2*(CIC_TILE+3)];
+	int base, cnt, k, ch;
+	int32_t sum;
+	/* history is s[-5..-1], or o[-3] e[-2] o[-2] e[-1] o[-1] */
+	for (ch=0; ch<2; ch++) {
+		od[ch]   = hist[ch];
+		ev[ch]   = hist[2+ch];
+		od[2+ch] = hist[4+ch];
+		ev[2+ch] = hist[6+ch];
+		od[4+ch] = hist[8+ch];
+	}
+	for (base=0; base < n/2; base += CIC_TILE) {
+		cnt = n/2 - base;
+		if (cnt > CIC_TILE) {
+			cnt = CIC_TILE;}
+		k = split_even_odd(iq + 4*base, ev + 4, od + 6, cnt);
+		for (; k<cnt; k++) {
+			ev[2*k+4] = iq[4*(base+k)];
+			ev[2*k+5] = iq[4*(base+k)+1];
+			od[2*k+6] = iq[4*(base+k)+2];
+			od[2*k+7] = iq[4*(base+k)+3];
+		}
+		/* the tile is copied out, so the output can overwrite it */
+		k = cic_kernel(ev, od, iq + 2*base, cnt);
+		for (; k<cnt; k++) {
+			for (ch=0; ch<2; ch++) {
+				sum = ev[2*k+4+ch] + ev[2*k+2+ch]*10 + ev[2*k+ch]*5
+				    + od[2*k+4+ch]*5 + od[2*k+2+ch]*10 + od[2*k+ch];
+				iq[2*(base+k)+ch] = clamp16(sum >> 4);
+			}
+		}
+		memmove(ev, ev + 2*cnt, 4 * sizeof(int16_t));
+		memmove(od, od + 2*cnt, 6 * sizeof(int16_t));
+	}
+	for (ch=0; ch<2; ch++) {
+		hist[ch]   = od[ch];
+		hist[2+ch] = ev[ch];
+		hist[4+ch] = od[2+ch];
+		hist[6+ch] = ev[2+ch];
+		hist[8+ch] = od[4+ch];
+	}
+}
+
+static void droop(int16_t *hist, int16_t *iq, int n, const int *fir)
+{
+	int16_t x[2*(CIC_TILE+9)];
+	int base, cnt, k;
+	memcpy(x, hist, 18 * sizeof(int16_t));
+	for (base=0; base < n; base += CIC_TILE) {
+		cnt = n - base;
+		if (cnt > CIC_TILE) {
+			cnt = CIC_TILE;}
+		memcpy(x + 18, iq + 2*base, 2 * cnt * sizeof(int16_t));
+		k = droop_kernel(x, iq + 2*base, cnt, fir);
+		for (; k<cnt; k++) {
+			iq[2*(base+k)]   = droop_one(x + 2*k, fir);
+			iq[2*(base+k)+1] = droop_one(x + 2*k + 1, fir);
+		}
+		memmove(x, x + 2*cnt, 18 * sizeof(int16_t));
+	}
+	memcpy(hist, x, 18 * sizeof(int16_t));
+}
+
+#endif
+
+int dsp_cic_decimate(struct dsp_cic *c, int16_t *iq, int len)
+{
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+	int i, n = len / 2;
+	for (i=0; i < c->passes; i++) {
+		cic_pass(c->hist[i], iq, n);
+		n /= 2;
+	}
+	if (c->comp) {
+		droop(c->droop, iq, n, cic_9_tables[c->passes]);}
+	return n * 2;
+#else
+	/* the tiles only pay off with vector kernels */
+	return dsp_cic_decimate_ref(c, iq, len);
+#endif
+}
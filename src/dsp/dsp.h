@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2014 by Kyle Keen <keenerd@gmail.com>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __DSP_H
+#define __DSP_H
+
+/* integer decimation shared by rtl_fm and rtl_power */
+
+#include <stdint.h>
+
+#define DSP_CIC_MAX_PASSES	10
+
+/*!
+ * State of a cascade of half band CIC decimators followed by an optional
+ * 9 tap droop compensation filter.  Every member is private; the history
+ * carries across calls so a stream can be fed block by block.
+ */
+
+struct dsp_cic
+{
+	int      passes;
+	int      comp;
+	/* last 5 complex samples seen by each pass, I/Q interleaved */
+	int16_t  hist[DSP_CIC_MAX_PASSES][10];
+	/* last 9 complex samples seen by the droop filter */
+	int16_t  droop[18];
+};
+
+/*!
+ * Reset a decimator
+ *
+ * \param c the decimator state
+ * \param passes number of decimate-by-2 stages, 1 to DSP_CIC_MAX_PASSES
+ * \param comp non-zero to follow the cascade with droop compensation
+ * \return 0 on success, -EINVAL if passes is out of range
+ */
+
+int dsp_cic_init(struct dsp_cic *c, int passes, int comp);
+
+/*!
+ * Decimate interleaved complex int16 samples in place
+ *
+ * Each pass is a [1 5 10 10 5 1] filter scaled by 1/16, a dc gain of 2,
+ * so the output grows by 6 dB per pass.  Results saturate to int16.
+ *
+ * \param c the decimator state
+ * \param iq interleaved I/Q samples, overwritten with the output
+ * \param len number of int16 values in iq, a multiple of 2 << passes
+ * \return number of int16 values written to iq
+ */
+
+int dsp_cic_decimate(struct dsp_cic *c, int16_t *iq, int len);
+
+/*!
+ * Plain C version of dsp_cic_decimate(), for benchmarks and checks
+ *
+ * Produces the same output as dsp_cic_decimate() on every platform.
+ *
+ * \param c the decimator state
+ * \param iq interleaved I/Q samples, overwritten with the output
+ * \param len number of int16 values in iq, a multiple of 2 << passes
+ * \return number of int16 values written to iq
+ */
+
+int dsp_cic_decimate_ref(struct dsp_cic *c, int16_t *iq, int len);
+
+#endif /* __DSP_H */
@@ -24,10 +24,12 @@
 #include <stdlib.h>
 #ifndef _WIN32
 #include <unistd.h>
+#include <time.h>
 #define min(a, b) (((a) < (b)) ? (a) : (b))
 #endif
 
 #include <libusb.h>
+#include <pthread.h>
 
 /*
  * All libusb callback functions should be marked with the LIBUSB_CALL macro
@@ -86,6 +88,11 @@ static const int fir_default[FIR_LEN] = {
 	101, 156, 215, 273, 327, 372, 404, 421	/* 12 bit signed */
 };
 
+/* prepared gain: bit 31 valid, bits 16-23 tuner index, bits 0-15 gain
+ * prepared bandwidth: bit 31 valid, bits 0-30 index into prepared_bw */
+#define PREPARED_VALID		(1U << 31)
+#define PREPARED_BW_MAX		8
+
 struct rtlsdr_dev {
 	libusb_context *ctx;
 	struct libusb_device_handle *devh;
@@ -95,9 +102,21 @@ struct rtlsdr_dev {
 	unsigned char **xfer_buf;
 	rtlsdr_read_async_cb_t cb;
 	void *cb_ctx;
+	/* group context */
+	rtlsdr_group_t *group;
+	rtlsdr_group_cb_t group_cb;
+	void *group_ctx;
+	uint64_t sample_count;
 	enum rtlsdr_async_status async_status;
 	int async_cancel;
-	int use_zerocopy;
+	int zerocopy; /* zero-copy buffers requested */
+	int use_zerocopy; /* zero-copy buffers in use */
+	uint32_t latency_target; /* us */
+	/* burst capture context */
+	int burst;
+	uint8_t *burst_dst;
+	uint32_t burst_left;
+	uint32_t burst_skip;
 	/* rtl demod context */
 	uint32_t rate; /* Hz */
 	uint32_t rtl_xtal; /* Hz */
@@ -109,22 +128,64 @@ struct rtlsdr_dev {
 	uint32_t tun_xtal; /* Hz */
 	uint32_t freq; /* Hz */
 	uint32_t bw;
+	uint32_t tuner_bw; /* Hz, filters programmed into the tuner, 0 unknown */
+	uint32_t rsamp_ratio; /* programmed into the demod, 0 unknown */
 	uint32_t offs_freq; /* Hz */
 	int corr; /* ppm */
 	int gain; /* tenth dB */
+	int manual_gain;
+	int agc_mode;
+	uint32_t req_rate; /* Hz, as requested by the user */
+	uint32_t bias_tee_gpios; /* bitmask of enabled bias tee gpios */
 	struct e4k_state e4k_s;
 	struct r82xx_config r82xx_c;
 	struct r82xx_priv r82xx_p;
+	/* tuner bandwidths prepared by rtlsdr_prepare_tuner_bandwidth() */
+	uint32_t prepared_bw[PREPARED_BW_MAX];
+	struct r82xx_bw_setting prepared_bw_r82xx[PREPARED_BW_MAX];
+	unsigned int prepared_bw_count;
+	/* control transfers, recursive; held across i2c repeater sequences
+	 * and for all of a reconnect */
+	pthread_mutex_t ctrl_lock;
 	/* status */
 	int dev_lost;
 	int driver_active;
 	unsigned int xfer_errors;
+	int xfer_pending;
 	char manufact[256];
 	char product[256];
+	char serial[256];
+	uint32_t index;
+	/* reconnect context */
+	int auto_reconnect;
+	uint32_t reconnect_timeout; /* ms, 0 waits until canceled */
+	uint32_t discontinuities;
+	uint32_t gap_ms;
+	unsigned int sim_loss_interval; /* transfers, see RTLSDR_SIMULATE_LOSS */
+	unsigned int sim_loss_count;
+	/* time spent in the steps of rtlsdr_open(), us */
+	uint32_t open_usb_us;
+	uint32_t open_baseband_us;
+	uint32_t open_probe_us;
+	uint32_t open_tuner_us;
+};
+
+#define GROUP_MAX_DEVICES	16
+
+struct rtlsdr_group {
+	libusb_context *ctx;
+	rtlsdr_dev_t *dev[GROUP_MAX_DEVICES];
+	uint32_t dev_count;
+	int cancel;
+	int running;
 };
 
 void rtlsdr_set_gpio_bit(rtlsdr_dev_t *dev, uint8_t gpio, int val);
+int rtlsdr_check_dongle_model(void *dev, char *manufact_check, char *product_check);
 static int rtlsdr_set_if_freq(rtlsdr_dev_t *dev, uint32_t freq);
+static void _rtlsdr_stop_burst(rtlsdr_dev_t *dev);
+static void LIBUSB_CALL _libusb_burst_callback(struct libusb_transfer *xfer);
+static uint64_t _rtlsdr_time_ns(void);
 
 /* generic tuner interface functions, shall be moved to the tuner implementations */
 int e4000_init(void *dev) {
@@ -224,6 +285,7 @@ int r820t_init(void *dev) {
 
 	devt->r82xx_c.max_i2c_msg_len = 8;
 	devt->r82xx_c.use_predetect = 0;
+	devt->r82xx_c.blog_v4 = rtlsdr_check_dongle_model(dev, "RTLSDRBlog", "Blog V4");
 	devt->r82xx_p.cfg = &devt->r82xx_c;
 
 	return r82xx_init(&devt->r82xx_p);
@@ -241,12 +303,16 @@ int r820t_set_freq(void *dev, uint32_t freq) {
 int r820t_set_bw(void *dev, int bw) {
 	int r;
 	rtlsdr_dev_t* devt = (rtlsdr_dev_t*)dev;
+	uint32_t int_freq = devt->r82xx_p.int_freq;
 
 	r = r82xx_set_bandwidth(&devt->r82xx_p, bw, devt->rate);
 	if(r < 0)
 		return r;
+	/* the IF, and with it the LO, only moves with some filter changes */
+	if ((uint32_t)r == int_freq && devt->tuner_bw)
+		return 0;
 	r = rtlsdr_set_if_freq(devt, r);
-	if (r)
+	if (r || !devt->freq)
 		return r;
 	return rtlsdr_set_center_freq(devt, devt->freq);
 }
@@ -353,6 +419,20 @@ static rtlsdr_dongle_t known_devices[] = {
 
 #define DEFAULT_BUF_NUMBER	15
 #define DEFAULT_BUF_LENGTH	(16 * 32 * 512)
+#define MIN_BUF_NUMBER		2
+#define MIN_BUF_LENGTH		512
+
+/* usbfs limits the memory of all submitted URBs to 16 MB by default */
+#define USBFS_MEMORY_LIMIT	(16 * 1024 * 1024)
+
+/* few small transfers for burst captures, they are flushed on each retune */
+#define BURST_BUF_NUMBER	8
+#define BURST_BUF_LENGTH	4096
+/* samples buffered in the RTL2832 endpoint FIFO */
+#define EPA_FIFO_LENGTH		4096
+
+/* a lost device that is not back by then ends the stream */
+#define DEF_RECONNECT_TIMEOUT	30000 /* ms */
 
 #define DEF_RTL_XTAL_FREQ	28800000
 #define MIN_RTL_XTAL_FREQ	(DEF_RTL_XTAL_FREQ - 1000)
@@ -402,12 +482,27 @@ enum blocks {
 	IICB			= 6,
 };
 
+/* fails instead of touching the handle if reconnecting has closed it */
+static int _rtlsdr_ctrl_transfer(rtlsdr_dev_t *dev, uint8_t type, uint16_t addr,
+				 uint16_t index, unsigned char *data, uint16_t len)
+{
+	int r = LIBUSB_ERROR_NO_DEVICE;
+
+	pthread_mutex_lock(&dev->ctrl_lock);
+	if (dev->devh)
+		r = libusb_control_transfer(dev->devh, type, 0, addr, index,
+					    data, len, CTRL_TIMEOUT);
+	pthread_mutex_unlock(&dev->ctrl_lock);
+
+	return r;
+}
+
 int rtlsdr_read_array(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_t *array, uint8_t len)
 {
 	int r;
 	uint16_t index = (block << 8);
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, array, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_IN, addr, index, array, len);
 #if 0
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -420,7 +515,7 @@ int rtlsdr_write_array(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_t
 	int r;
 	uint16_t index = (block << 8) | 0x10;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, array, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_OUT, addr, index, array, len);
 #if 0
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -476,7 +571,7 @@ uint16_t rtlsdr_read_reg(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint8_
 	uint16_t index = (block << 8);
 	uint16_t reg;
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_IN, addr, index, data, len);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -500,7 +595,7 @@ int rtlsdr_write_reg(rtlsdr_dev_t *dev, uint8_t block, uint16_t addr, uint16_t v
 
 	data[1] = val & 0xff;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_OUT, addr, index, data, len);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -517,7 +612,7 @@ uint16_t rtlsdr_demod_read_reg(rtlsdr_dev_t *dev, uint8_t page, uint16_t addr, u
 	uint16_t reg;
 	addr = (addr << 8) | 0x20;
 
-	r = libusb_control_transfer(dev->devh, CTRL_IN, 0, addr, index, data, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_IN, addr, index, data, len);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -541,7 +636,7 @@ int rtlsdr_demod_write_reg(rtlsdr_dev_t *dev, uint8_t page, uint16_t addr, uint1
 
 	data[1] = val & 0xff;
 
-	r = libusb_control_transfer(dev->devh, CTRL_OUT, 0, addr, index, data, len, CTRL_TIMEOUT);
+	r = _rtlsdr_ctrl_transfer(dev, CTRL_OUT, addr, index, data, len);
 
 	if (r < 0)
 		fprintf(stderr, "%s failed with %d\n", __FUNCTION__, r);
@@ -572,9 +667,18 @@ void rtlsdr_set_gpio_output(rtlsdr_dev_t *dev, uint8_t gpio)
 	rtlsdr_write_reg(dev, SYSB, GPOE, r | gpio, 1);
 }
 
+/* the tuner is only reachable while the repeater is on, so the control
+ * lock is held from switching it on until it is off again: another thread
+ * can not interleave its own i2c sequence, nor a reconnect pull the handle */
 void rtlsdr_set_i2c_repeater(rtlsdr_dev_t *dev, int on)
 {
+	if (on)
+		pthread_mutex_lock(&dev->ctrl_lock);
+
 	rtlsdr_demod_write_reg(dev, 1, 0x01, on ? 0x18 : 0x10, 1);
+
+	if (!on)
+		pthread_mutex_unlock(&dev->ctrl_lock);
 }
 
 int rtlsdr_set_fir(rtlsdr_dev_t *dev)
@@ -610,10 +714,37 @@ int rtlsdr_set_fir(rtlsdr_dev_t *dev)
 	return 0;
 }
 
+int rtlsdr_set_fir_coeffs(rtlsdr_dev_t *dev, const int16_t *coeffs)
+{
+	int i;
+
+	if (!dev)
+		return -1;
+
+	if (!coeffs) {
+		memcpy(dev->fir, fir_default, sizeof(fir_default));
+		return rtlsdr_set_fir(dev);
+	}
+
+	/* the chip takes 8 taps of 8 bit followed by 8 taps of 12 bit */
+	for (i = 0; i < FIR_LEN; i++) {
+		if ((i < 8 && (coeffs[i] < -128 || coeffs[i] > 127)) ||
+		    coeffs[i] < -2048 || coeffs[i] > 2047)
+			return -EINVAL;
+	}
+
+	for (i = 0; i < FIR_LEN; i++)
+		dev->fir[i] = coeffs[i];
+
+	return rtlsdr_set_fir(dev);
+}
+
 void rtlsdr_init_baseband(rtlsdr_dev_t *dev)
 {
 	unsigned int i;
 
+	dev->rsamp_ratio = 0;
+
 	/* initialize USB */
 	rtlsdr_write_reg(dev, USBB, USB_SYSCTL, 0x09, 1);
 	rtlsdr_write_reg(dev, USBB, USB_EPA_MAXPKT, 0x0002, 2);
@@ -737,6 +868,10 @@ int rtlsdr_set_xtal_freq(rtlsdr_dev_t *dev, uint32_t rtl_freq, uint32_t tuner_fr
 	if (rtl_freq > 0 && dev->rtl_xtal != rtl_freq) {
 		dev->rtl_xtal = rtl_freq;
 
+		/* the IF depends on the xtal too, program everything again */
+		dev->tuner_bw = 0;
+		dev->rsamp_ratio = 0;
+
 		/* update xtal-dependent settings */
 		if (dev->rate)
 			r = rtlsdr_set_sample_rate(dev, dev->rate);
@@ -912,6 +1047,41 @@ uint32_t rtlsdr_get_center_freq(rtlsdr_dev_t *dev)
 	return dev->freq;
 }
 
+int rtlsdr_set_pll_lock_check(rtlsdr_dev_t *dev, int deferred)
+{
+	if (!dev)
+		return -1;
+
+	if (dev->tuner_type != RTLSDR_TUNER_R820T &&
+	    dev->tuner_type != RTLSDR_TUNER_R828D)
+		return -2;
+
+	dev->r82xx_p.lock_deferred = deferred;
+
+	return 0;
+}
+
+int rtlsdr_check_pll_lock(rtlsdr_dev_t *dev, uint32_t *failures)
+{
+	int r;
+
+	if (!dev)
+		return -1;
+
+	if (dev->tuner_type != RTLSDR_TUNER_R820T &&
+	    dev->tuner_type != RTLSDR_TUNER_R828D)
+		return -2;
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	r = r82xx_check_lock(&dev->r82xx_p);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	if (failures)
+		*failures = dev->r82xx_p.lock_failures;
+
+	return r;
+}
+
 int rtlsdr_set_freq_correction(rtlsdr_dev_t *dev, int ppm)
 {
 	int r = 0;
@@ -1007,6 +1177,23 @@ int rtlsdr_get_tuner_gains(rtlsdr_dev_t *dev, int *gains)
 	}
 }
 
+/* program the tuner filters, unless they are already set up for bw */
+static int rtlsdr_update_tuner_bw(rtlsdr_dev_t *dev, uint32_t bw)
+{
+	int r;
+
+	if (!dev->tuner->set_bw || bw == dev->tuner_bw)
+		return 0;
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	r = dev->tuner->set_bw(dev, bw);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	dev->tuner_bw = r ? 0 : bw;
+
+	return r;
+}
+
 int rtlsdr_set_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw)
 {
 	int r = 0;
@@ -1015,9 +1202,7 @@ int rtlsdr_set_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw)
 		return -1;
 
 	if (dev->tuner->set_bw) {
-		rtlsdr_set_i2c_repeater(dev, 1);
-		r = dev->tuner->set_bw(dev, bw > 0 ? bw : dev->rate);
-		rtlsdr_set_i2c_repeater(dev, 0);
+		r = rtlsdr_update_tuner_bw(dev, bw > 0 ? bw : dev->rate);
 		if (r)
 			return r;
 		dev->bw = bw;
@@ -1046,6 +1231,49 @@ int rtlsdr_set_tuner_gain(rtlsdr_dev_t *dev, int gain)
 	return r;
 }
 
+int rtlsdr_prepare_tuner_gain(rtlsdr_dev_t *dev, int gain, uint32_t *prepared)
+{
+	uint32_t index = 0;
+
+	if (!dev || !dev->tuner || !prepared)
+		return -1;
+
+	if (dev->tuner_type == RTLSDR_TUNER_R820T ||
+	    dev->tuner_type == RTLSDR_TUNER_R828D)
+		index = r82xx_gain_index(&dev->r82xx_p, gain);
+
+	*prepared = PREPARED_VALID | (index << 16) | (uint16_t)gain;
+
+	return 0;
+}
+
+int rtlsdr_set_prepared_tuner_gain(rtlsdr_dev_t *dev, uint32_t prepared)
+{
+	int gain = (int16_t)(prepared & 0xffff);
+	int r;
+
+	if (!dev || !dev->tuner)
+		return -1;
+
+	if (!(prepared & PREPARED_VALID))
+		return -EINVAL;
+
+	if (dev->tuner_type != RTLSDR_TUNER_R820T &&
+	    dev->tuner_type != RTLSDR_TUNER_R828D)
+		return rtlsdr_set_tuner_gain(dev, gain);
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	r = r82xx_set_gain_index(&dev->r82xx_p, (prepared >> 16) & 0xff);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	if (!r)
+		dev->gain = gain;
+	else
+		dev->gain = 0;
+
+	return r;
+}
+
 int rtlsdr_get_tuner_gain(rtlsdr_dev_t *dev)
 {
 	if (!dev)
@@ -1054,6 +1282,96 @@ int rtlsdr_get_tuner_gain(rtlsdr_dev_t *dev)
 	return dev->gain;
 }
 
+int rtlsdr_prepare_tuner_bandwidth(rtlsdr_dev_t *dev, uint32_t bw,
+				   uint32_t *prepared)
+{
+	unsigned int i;
+
+	if (!dev || !dev->tuner || !prepared)
+		return -1;
+
+	if (!bw)
+		bw = dev->rate;
+
+	for (i = 0; i < dev->prepared_bw_count; i++) {
+		if (dev->prepared_bw[i] == bw)
+			break;
+	}
+
+	if (i == dev->prepared_bw_count) {
+		if (i == PREPARED_BW_MAX)
+			return -ENOMEM;
+
+		dev->prepared_bw[i] = bw;
+		r82xx_prepare_bandwidth(bw, &dev->prepared_bw_r82xx[i]);
+		dev->prepared_bw_count++;
+	}
+
+	*prepared = PREPARED_VALID | i;
+
+	return 0;
+}
+
+int rtlsdr_set_channel(rtlsdr_dev_t *dev, uint32_t freq,
+		       uint32_t prepared_gain, uint32_t prepared_bw)
+{
+	struct r82xx_bw_setting *setting = NULL;
+	uint32_t bw_index = prepared_bw & ~PREPARED_VALID;
+	int gain_index = -1;
+	int new_if = 0;
+	int r = 0;
+
+	if (!dev || !dev->tuner)
+		return -1;
+
+	if ((prepared_gain && !(prepared_gain & PREPARED_VALID)) ||
+	    (prepared_bw && (!(prepared_bw & PREPARED_VALID) ||
+			     bw_index >= dev->prepared_bw_count)))
+		return -EINVAL;
+
+	if ((dev->tuner_type != RTLSDR_TUNER_R820T &&
+	     dev->tuner_type != RTLSDR_TUNER_R828D) || dev->direct_sampling) {
+		if (prepared_gain)
+			r = rtlsdr_set_prepared_tuner_gain(dev, prepared_gain);
+		if (!r && prepared_bw)
+			r = rtlsdr_set_tuner_bandwidth(dev,
+						       dev->prepared_bw[bw_index]);
+		if (!r)
+			r = rtlsdr_set_center_freq(dev, freq);
+		return r;
+	}
+
+	if (prepared_bw) {
+		setting = &dev->prepared_bw_r82xx[bw_index];
+		new_if = setting->int_freq != dev->r82xx_p.int_freq;
+	}
+
+	if (prepared_gain)
+		gain_index = (prepared_gain >> 16) & 0xff;
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	r = r82xx_set_channel(&dev->r82xx_p, freq - dev->offs_freq,
+			      setting, gain_index);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	/* the demod follows the tuner, a failed retune leaves both as they were */
+	if (!r && new_if)
+		r = rtlsdr_set_if_freq(dev, setting->int_freq);
+
+	if (r) {
+		dev->freq = 0;
+		return r;
+	}
+
+	dev->freq = freq;
+	if (prepared_gain)
+		dev->gain = (int16_t)(prepared_gain & 0xffff);
+	if (prepared_bw)
+		dev->bw = dev->tuner_bw = dev->prepared_bw[bw_index];
+
+	return 0;
+}
+
 int rtlsdr_set_tuner_if_gain(rtlsdr_dev_t *dev, int stage, int gain)
 {
 	int r = 0;
@@ -1083,6 +1401,9 @@ int rtlsdr_set_tuner_gain_mode(rtlsdr_dev_t *dev, int mode)
 		rtlsdr_set_i2c_repeater(dev, 0);
 	}
 
+	if (!r)
+		dev->manual_gain = mode;
+
 	return r;
 }
 
@@ -1103,6 +1424,8 @@ int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 		return -EINVAL;
 	}
 
+	dev->req_rate = samp_rate;
+
 	rsamp_ratio = (dev->rtl_xtal * TWO_POW(22)) / samp_rate;
 	rsamp_ratio &= 0x0ffffffc;
 
@@ -1114,11 +1437,15 @@ int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 
 	dev->rate = (uint32_t)real_rate;
 
-	if (dev->tuner && dev->tuner->set_bw) {
-		rtlsdr_set_i2c_repeater(dev, 1);
-		dev->tuner->set_bw(dev, dev->bw > 0 ? dev->bw : dev->rate);
-		rtlsdr_set_i2c_repeater(dev, 0);
-	}
+	/* with offset tuning the filters are set up below */
+	if (dev->tuner && !dev->offs_freq)
+		rtlsdr_update_tuner_bw(dev, dev->bw > 0 ? dev->bw : dev->rate);
+
+	/* nothing below depends on anything but the resampler ratio */
+	if (rsamp_ratio == dev->rsamp_ratio)
+		return 0;
+
+	dev->rsamp_ratio = rsamp_ratio;
 
 	tmp = (rsamp_ratio >> 16);
 	r |= rtlsdr_demod_write_reg(dev, 1, 0x9f, tmp, 2);
@@ -1135,6 +1462,39 @@ int rtlsdr_set_sample_rate(rtlsdr_dev_t *dev, uint32_t samp_rate)
 	if (dev->offs_freq)
 		rtlsdr_set_offset_tuning(dev, 1);
 
+	if (r)
+		dev->rsamp_ratio = 0;
+
+	return r;
+}
+
+int rtlsdr_set_sample_rate_and_freq(rtlsdr_dev_t *dev, uint32_t samp_rate,
+				    uint32_t freq)
+{
+	uint32_t old_freq;
+	int r;
+
+	if (!dev)
+		return -1;
+
+	/*
+	 * Keep the filter and resampler changes from retuning to the old
+	 * frequency, the tuner is set once when everything else is done.
+	 * A reconnect must not see the zero meanwhile, it would not retune.
+	 */
+	pthread_mutex_lock(&dev->ctrl_lock);
+	old_freq = dev->freq;
+	dev->freq = 0;
+
+	r = rtlsdr_set_sample_rate(dev, samp_rate);
+	if (!r)
+		r = rtlsdr_set_center_freq(dev, freq);
+
+	/* later bandwidth changes and a reconnect retune to dev->freq */
+	if (r)
+		dev->freq = old_freq;
+	pthread_mutex_unlock(&dev->ctrl_lock);
+
 	return r;
 }
 
@@ -1159,6 +1519,8 @@ int rtlsdr_set_agc_mode(rtlsdr_dev_t *dev, int on)
 	if (!dev)
 		return -1;
 
+	dev->agc_mode = on;
+
 	return rtlsdr_demod_write_reg(dev, 0, 0x19, on ? 0x25 : 0x05, 1);
 }
 
@@ -1174,6 +1536,7 @@ int rtlsdr_set_direct_sampling(rtlsdr_dev_t *dev, int on)
 			rtlsdr_set_i2c_repeater(dev, 1);
 			r = dev->tuner->exit(dev);
 			rtlsdr_set_i2c_repeater(dev, 0);
+			dev->tuner_bw = 0;
 		}
 
 		/* disable Zero-IF mode */
@@ -1195,6 +1558,7 @@ int rtlsdr_set_direct_sampling(rtlsdr_dev_t *dev, int on)
 			rtlsdr_set_i2c_repeater(dev, 1);
 			r |= dev->tuner->init(dev);
 			rtlsdr_set_i2c_repeater(dev, 0);
+			dev->tuner_bw = 0;
 		}
 
 		if ((dev->tuner_type == RTLSDR_TUNER_R820T) ||
@@ -1253,7 +1617,6 @@ int rtlsdr_set_offset_tuning(rtlsdr_dev_t *dev, int on)
 	r |= rtlsdr_set_if_freq(dev, dev->offs_freq);
 
 	if (dev->tuner && dev->tuner->set_bw) {
-		rtlsdr_set_i2c_repeater(dev, 1);
 		if (on) {
 			bw = 2 * dev->offs_freq;
 		} else if (dev->bw > 0) {
@@ -1261,8 +1624,7 @@ int rtlsdr_set_offset_tuning(rtlsdr_dev_t *dev, int on)
 		} else {
 			bw = dev->rate;
 		}
-		dev->tuner->set_bw(dev, bw);
-		rtlsdr_set_i2c_repeater(dev, 0);
+		rtlsdr_update_tuner_bw(dev, bw);
 	}
 
 	if (dev->freq > dev->offs_freq)
@@ -1442,63 +1804,69 @@ int rtlsdr_check_dongle_model(void *dev, char *manufact_check, char *product_che
 }
 
 
-int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
+/*
+ * Open and claim the index-th known device, or the one with the given
+ * serial number if serial is not NULL.
+ */
+static int rtlsdr_open_usb(rtlsdr_dev_t *dev, uint32_t index, const char *serial)
 {
-	int r;
+	int r = -1;
 	int i;
 	libusb_device **list;
-	rtlsdr_dev_t *dev = NULL;
 	libusb_device *device = NULL;
 	uint32_t device_count = 0;
 	struct libusb_device_descriptor dd;
-	uint8_t reg;
+	char str[256];
 	ssize_t cnt;
 
-	dev = malloc(sizeof(rtlsdr_dev_t));
-	if (NULL == dev)
-		return -ENOMEM;
-
-	memset(dev, 0, sizeof(rtlsdr_dev_t));
-	memcpy(dev->fir, fir_default, sizeof(fir_default));
-
-	r = libusb_init(&dev->ctx);
-	if(r < 0){
-		free(dev);
-		return -1;
-	}
-
-	dev->dev_lost = 1;
-
 	cnt = libusb_get_device_list(dev->ctx, &list);
 
 	for (i = 0; i < cnt; i++) {
-		device = list[i];
-
 		libusb_get_device_descriptor(list[i], &dd);
 
-		if (find_known_device(dd.idVendor, dd.idProduct)) {
-			device_count++;
-		}
+		if (!find_known_device(dd.idVendor, dd.idProduct))
+			continue;
 
-		if (index == device_count - 1)
-			break;
+		device_count++;
+
+		if (serial) {
+			if (libusb_open(list[i], &dev->devh) < 0)
+				continue;
 
-		device = NULL;
+			memset(str, 0, sizeof(str));
+			libusb_get_string_descriptor_ascii(dev->devh,
+							   dd.iSerialNumber,
+							   (unsigned char *)str,
+							   sizeof(str));
+			if (!strcmp(serial, str)) {
+				device = list[i];
+				break;
+			}
+
+			libusb_close(dev->devh);
+			dev->devh = NULL;
+		} else if (index == device_count - 1) {
+			device = list[i];
+			break;
+		}
 	}
 
 	if (!device) {
-		r = -1;
-		goto err;
+		libusb_free_device_list(list, 1);
+		return -1;
 	}
 
-	r = libusb_open(device, &dev->devh);
-	if (r < 0) {
-		libusb_free_device_list(list, 1);
-		fprintf(stderr, "usb_open error %d\n", r);
-		if(r == LIBUSB_ERROR_ACCESS)
-			fprintf(stderr, "Please fix the device permissions, e.g. "
-			"by installing the udev rules file rtl-sdr.rules\n");
-		goto err;
+	if (!dev->devh) {
+		r = libusb_open(device, &dev->devh);
+		if (r < 0) {
+			libusb_free_device_list(list, 1);
+			fprintf(stderr, "usb_open error %d\n", r);
+			if(r == LIBUSB_ERROR_ACCESS)
+				fprintf(stderr, "Please fix the device permissions, e.g. "
+				"by installing the udev rules file rtl-sdr.rules\n");
+			dev->devh = NULL;
+			return r;
+		}
 	}
 
 	libusb_free_device_list(list, 1);
@@ -1511,6 +1879,7 @@ int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
 			fprintf(stderr, "Detached kernel driver\n");
 		} else {
 			fprintf(stderr, "Detaching kernel driver failed!");
+			r = -1;
 			goto err;
 		}
 #else
@@ -1529,42 +1898,151 @@ int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
 		goto err;
 	}
 
-	dev->rtl_xtal = DEF_RTL_XTAL_FREQ;
-
 	/* perform a dummy write, if it fails, reset the device */
 	if (rtlsdr_write_reg(dev, USBB, USB_SYSCTL, 0x09, 1) < 0) {
 		fprintf(stderr, "Resetting device...\n");
 		libusb_reset_device(dev->devh);
 	}
 
-	rtlsdr_init_baseband(dev);
-	dev->dev_lost = 0;
+	return 0;
+err:
+	libusb_close(dev->devh);
+	dev->devh = NULL;
 
-	/* Get device manufacturer and product id */
-	r = rtlsdr_get_usb_strings(dev, dev->manufact, dev->product, NULL);
+	return r;
+}
 
-	/* Probe tuners */
-	rtlsdr_set_i2c_repeater(dev, 1);
+/*
+ * Set up the demodulator for the detected tuner and initialize the tuner,
+ * the i2c repeater has to be enabled by the caller.
+ */
+static int rtlsdr_init_tuner(rtlsdr_dev_t *dev)
+{
+	switch (dev->tuner_type) {
+	case RTLSDR_TUNER_R828D:
+	case RTLSDR_TUNER_R820T:
+		/* disable Zero-IF mode */
+		rtlsdr_demod_write_reg(dev, 1, 0xb1, 0x1a, 1);
 
-	reg = rtlsdr_i2c_read_reg(dev, E4K_I2C_ADDR, E4K_CHECK_ADDR);
-	if (reg == E4K_CHECK_VAL) {
-		fprintf(stderr, "Found Elonics E4000 tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_E4000;
-		goto found;
-	}
+		/* only enable In-phase ADC input */
+		rtlsdr_demod_write_reg(dev, 0, 0x08, 0x4d, 1);
 
-	reg = rtlsdr_i2c_read_reg(dev, FC0013_I2C_ADDR, FC0013_CHECK_ADDR);
-	if (reg == FC0013_CHECK_VAL) {
-		fprintf(stderr, "Found Fitipower FC0013 tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_FC0013;
-		goto found;
-	}
+		/* the R82XX use 3.57 MHz IF for the DVB-T 6 MHz mode, and
+		 * 4.57 MHz for the 8 MHz mode */
+		rtlsdr_set_if_freq(dev, R82XX_IF_FREQ);
 
-	reg = rtlsdr_i2c_read_reg(dev, R820T_I2C_ADDR, R82XX_CHECK_ADDR);
-	if (reg == R82XX_CHECK_VAL) {
-		fprintf(stderr, "Found Rafael Micro R820T tuner\n");
-		dev->tuner_type = RTLSDR_TUNER_R820T;
-		goto found;
+		/* enable spectrum inversion */
+		rtlsdr_demod_write_reg(dev, 1, 0x15, 0x01, 1);
+		break;
+	case RTLSDR_TUNER_UNKNOWN:
+		fprintf(stderr, "No supported tuner found\n");
+		rtlsdr_set_direct_sampling(dev, 1);
+		break;
+	default:
+		break;
+	}
+
+	dev->tuner_bw = 0;
+
+	if (dev->tuner->init)
+		return dev->tuner->init(dev);
+
+	return 0;
+}
+
+/* open a device, in the libusb context of the group if grp is not NULL */
+static int _rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index,
+			rtlsdr_group_t *grp)
+{
+	int r;
+	rtlsdr_dev_t *dev = NULL;
+	uint8_t reg;
+	const char *env;
+	uint64_t t0, t1;
+	pthread_mutexattr_t attr;
+
+	t0 = _rtlsdr_time_ns();
+
+	dev = malloc(sizeof(rtlsdr_dev_t));
+	if (NULL == dev)
+		return -ENOMEM;
+
+	memset(dev, 0, sizeof(rtlsdr_dev_t));
+	memcpy(dev->fir, fir_default, sizeof(fir_default));
+
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&dev->ctrl_lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
+	if (grp) {
+		dev->group = grp;
+		dev->ctx = grp->ctx;
+	} else {
+		r = libusb_init(&dev->ctx);
+		if(r < 0){
+			pthread_mutex_destroy(&dev->ctrl_lock);
+			free(dev);
+			return -1;
+		}
+	}
+
+	dev->dev_lost = 1;
+
+	r = rtlsdr_open_usb(dev, index, NULL);
+	if (r < 0)
+		goto err;
+
+	dev->index = index;
+	dev->rtl_xtal = DEF_RTL_XTAL_FREQ;
+
+	t1 = _rtlsdr_time_ns();
+	dev->open_usb_us = (uint32_t)((t1 - t0) / 1000);
+	t0 = t1;
+
+	rtlsdr_init_baseband(dev);
+	dev->dev_lost = 0;
+
+	t1 = _rtlsdr_time_ns();
+	dev->open_baseband_us = (uint32_t)((t1 - t0) / 1000);
+	t0 = t1;
+
+	/* Get device manufacturer, product id and serial number */
+	r = rtlsdr_get_usb_strings(dev, dev->manufact, dev->product, dev->serial);
+
+	/* simulate a device loss every n transfers, for testing reconnects */
+	env = getenv("RTLSDR_SIMULATE_LOSS");
+	if (env)
+		dev->sim_loss_interval = atoi(env);
+
+	dev->reconnect_timeout = DEF_RECONNECT_TIMEOUT;
+
+	/* zero-copy buffers are used if available, unless disabled here */
+	env = getenv("RTLSDR_ZEROCOPY");
+	dev->zerocopy = env ? atoi(env) : 1;
+
+	/* Probe tuners */
+	rtlsdr_set_i2c_repeater(dev, 1);
+
+	reg = rtlsdr_i2c_read_reg(dev, E4K_I2C_ADDR, E4K_CHECK_ADDR);
+	if (reg == E4K_CHECK_VAL) {
+		fprintf(stderr, "Found Elonics E4000 tuner\n");
+		dev->tuner_type = RTLSDR_TUNER_E4000;
+		goto found;
+	}
+
+	reg = rtlsdr_i2c_read_reg(dev, FC0013_I2C_ADDR, FC0013_CHECK_ADDR);
+	if (reg == FC0013_CHECK_VAL) {
+		fprintf(stderr, "Found Fitipower FC0013 tuner\n");
+		dev->tuner_type = RTLSDR_TUNER_FC0013;
+		goto found;
+	}
+
+	reg = rtlsdr_i2c_read_reg(dev, R820T_I2C_ADDR, R82XX_CHECK_ADDR);
+	if (reg == R82XX_CHECK_VAL) {
+		fprintf(stderr, "Found Rafael Micro R820T tuner\n");
+		dev->tuner_type = RTLSDR_TUNER_R820T;
+		goto found;
 	}
 
 	reg = rtlsdr_i2c_read_reg(dev, R828D_I2C_ADDR, R82XX_CHECK_ADDR);
@@ -1605,40 +2083,21 @@ found:
 	dev->tun_xtal = dev->rtl_xtal;
 	dev->tuner = &tuners[dev->tuner_type];
 
-	switch (dev->tuner_type) {
-	case RTLSDR_TUNER_R828D:
-		/* If NOT an RTL-SDR Blog V4, set typical R828D 16 MHz freq. Otherwise, keep at 28.8 MHz. */
-		if (!(rtlsdr_check_dongle_model(dev, "RTLSDRBlog", "Blog V4"))) {
-			dev->tun_xtal = R828D_XTAL_FREQ;
-		}
-		/* fall-through */
-	case RTLSDR_TUNER_R820T:
-		/* disable Zero-IF mode */
-		rtlsdr_demod_write_reg(dev, 1, 0xb1, 0x1a, 1);
+	/* If NOT an RTL-SDR Blog V4, set typical R828D 16 MHz freq. Otherwise, keep at 28.8 MHz. */
+	if (dev->tuner_type == RTLSDR_TUNER_R828D &&
+	    !rtlsdr_check_dongle_model(dev, "RTLSDRBlog", "Blog V4"))
+		dev->tun_xtal = R828D_XTAL_FREQ;
 
-		/* only enable In-phase ADC input */
-		rtlsdr_demod_write_reg(dev, 0, 0x08, 0x4d, 1);
+	t1 = _rtlsdr_time_ns();
+	dev->open_probe_us = (uint32_t)((t1 - t0) / 1000);
+	t0 = t1;
 
-		/* the R82XX use 3.57 MHz IF for the DVB-T 6 MHz mode, and
-		 * 4.57 MHz for the 8 MHz mode */
-		rtlsdr_set_if_freq(dev, R82XX_IF_FREQ);
-
-		/* enable spectrum inversion */
-		rtlsdr_demod_write_reg(dev, 1, 0x15, 0x01, 1);
-		break;
-	case RTLSDR_TUNER_UNKNOWN:
-		fprintf(stderr, "No supported tuner found\n");
-		rtlsdr_set_direct_sampling(dev, 1);
-		break;
-	default:
-		break;
-	}
-
-	if (dev->tuner->init)
-		r = dev->tuner->init(dev);
+	r = rtlsdr_init_tuner(dev);
 
 	rtlsdr_set_i2c_repeater(dev, 0);
 
+	dev->open_tuner_us = (uint32_t)((_rtlsdr_time_ns() - t0) / 1000);
+
 	*out_dev = dev;
 
 	return 0;
@@ -1647,20 +2106,29 @@ err:
 		if (dev->devh)
 			libusb_close(dev->devh);
 
-		if (dev->ctx)
+		if (dev->ctx && !dev->group)
 			libusb_exit(dev->ctx);
 
+		pthread_mutex_destroy(&dev->ctrl_lock);
 		free(dev);
 	}
 
 	return r;
 }
 
+int rtlsdr_open(rtlsdr_dev_t **out_dev, uint32_t index)
+{
+	return _rtlsdr_open(out_dev, index, NULL);
+}
+
 int rtlsdr_close(rtlsdr_dev_t *dev)
 {
 	if (!dev)
 		return -1;
 
+	if (dev->burst)
+		_rtlsdr_stop_burst(dev);
+
 	if(!dev->dev_lost) {
 		/* block until all async operations have been completed (if any) */
 		while (RTLSDR_INACTIVE != dev->async_status) {
@@ -1674,21 +2142,37 @@ int rtlsdr_close(rtlsdr_dev_t *dev)
 		rtlsdr_deinit_baseband(dev);
 	}
 
-	libusb_release_interface(dev->devh, 0);
+	/* the handle is gone if reconnecting after a device loss failed */
+	if (dev->devh) {
+		libusb_release_interface(dev->devh, 0);
 
 #ifdef DETACH_KERNEL_DRIVER
-	if (dev->driver_active) {
-		if (!libusb_attach_kernel_driver(dev->devh, 0))
-			fprintf(stderr, "Reattached kernel driver\n");
-		else
-			fprintf(stderr, "Reattaching kernel driver failed!\n");
-	}
+		if (dev->driver_active) {
+			if (!libusb_attach_kernel_driver(dev->devh, 0))
+				fprintf(stderr, "Reattached kernel driver\n");
+			else
+				fprintf(stderr, "Reattaching kernel driver failed!\n");
+		}
 #endif
 
-	libusb_close(dev->devh);
+		libusb_close(dev->devh);
+	}
 
-	libusb_exit(dev->ctx);
+	if (dev->group) {
+		rtlsdr_group_t *grp = dev->group;
+		uint32_t i;
 
+		for (i = 0; i < grp->dev_count; i++) {
+			if (grp->dev[i] == dev) {
+				grp->dev[i] = grp->dev[--grp->dev_count];
+				break;
+			}
+		}
+	} else {
+		libusb_exit(dev->ctx);
+	}
+
+	pthread_mutex_destroy(&dev->ctrl_lock);
 	free(dev);
 
 	return 0;
@@ -1710,20 +2194,71 @@ int rtlsdr_read_sync(rtlsdr_dev_t *dev, void *buf, int len, int *n_read)
 	if (!dev)
 		return -1;
 
+	if (dev->burst)
+		return -2;
+
 	return libusb_bulk_transfer(dev->devh, 0x81, buf, len, n_read, BULK_TIMEOUT);
 }
 
+/* monotonic host time in ns, common to all devices */
+static uint64_t _rtlsdr_time_ns(void)
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000 +
+	       (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000 /
+	       freq.QuadPart;
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static uint64_t _rtlsdr_time_ms(void)
+{
+	return _rtlsdr_time_ns() / 1000000;
+}
+
 static void LIBUSB_CALL _libusb_callback(struct libusb_transfer *xfer)
 {
 	rtlsdr_dev_t *dev = (rtlsdr_dev_t *)xfer->user_data;
 
+	if (LIBUSB_TRANSFER_COMPLETED == xfer->status &&
+	    dev->sim_loss_interval &&
+	    ++dev->sim_loss_count >= dev->sim_loss_interval) {
+		dev->sim_loss_count = 0;
+		xfer->status = LIBUSB_TRANSFER_NO_DEVICE;
+	}
+
 	if (LIBUSB_TRANSFER_COMPLETED == xfer->status) {
-		if (dev->cb)
+		if (dev->cb) {
 			dev->cb(xfer->buffer, xfer->actual_length, dev->cb_ctx);
+		} else if (dev->group_cb) {
+			rtlsdr_stream_info_t info;
+
+			info.sample = dev->sample_count;
+			info.host_ns = _rtlsdr_time_ns();
+			info.discontinuities = dev->discontinuities;
+			dev->group_cb(dev, xfer->buffer, xfer->actual_length,
+				      &info, dev->group_ctx);
+		}
+		dev->sample_count += xfer->actual_length / 2;
 
-		libusb_submit_transfer(xfer); /* resubmit transfer */
+		if (libusb_submit_transfer(xfer) < 0) /* resubmit transfer */
+			dev->xfer_pending--;
 		dev->xfer_errors = 0;
-	} else if (LIBUSB_TRANSFER_CANCELLED != xfer->status) {
+	} else {
+		dev->xfer_pending--;
+
+		if (LIBUSB_TRANSFER_CANCELLED == xfer->status)
+			return;
 #ifndef _WIN32
 		if (LIBUSB_TRANSFER_ERROR == xfer->status)
 			dev->xfer_errors++;
@@ -1766,11 +2301,15 @@ static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
 	dev->xfer_buf = malloc(dev->xfer_buf_num * sizeof(unsigned char *));
 	memset(dev->xfer_buf, 0, dev->xfer_buf_num * sizeof(unsigned char *));
 
+	dev->use_zerocopy = 0;
+
 #if defined(ENABLE_ZEROCOPY) && defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
-	fprintf(stderr, "Allocating %d zero-copy buffers\n", dev->xfer_buf_num);
+	if (dev->zerocopy) {
+		fprintf(stderr, "Allocating %d zero-copy buffers\n", dev->xfer_buf_num);
+		dev->use_zerocopy = 1;
+	}
 
-	dev->use_zerocopy = 1;
-	for (i = 0; i < dev->xfer_buf_num; ++i) {
+	for (i = 0; dev->use_zerocopy && i < dev->xfer_buf_num; ++i) {
 		dev->xfer_buf[i] = libusb_dev_mem_alloc(dev->devh, dev->xfer_buf_len);
 
 		if (dev->xfer_buf[i]) {
@@ -1786,6 +2325,8 @@ static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
 				fprintf(stderr, "Detected Kernel usbfs mmap() "
 						"bug, falling back to buffers "
 						"in userspace\n");
+				/* don't probe again for this device */
+				dev->zerocopy = 0;
 				dev->use_zerocopy = 0;
 				break;
 			}
@@ -1806,12 +2347,14 @@ static int _rtlsdr_alloc_async_buffers(rtlsdr_dev_t *dev)
 				libusb_dev_mem_free(dev->devh,
 						    dev->xfer_buf[i],
 						    dev->xfer_buf_len);
+			dev->xfer_buf[i] = NULL;
 		}
 	}
 #endif
 
 	/* no zero-copy available, allocate buffers in userspace */
 	if (!dev->use_zerocopy) {
+		fprintf(stderr, "Allocating %d userspace buffers\n", dev->xfer_buf_num);
 		for (i = 0; i < dev->xfer_buf_num; ++i) {
 			dev->xfer_buf[i] = malloc(dev->xfer_buf_len);
 
@@ -1863,38 +2406,11 @@ static int _rtlsdr_free_async_buffers(rtlsdr_dev_t *dev)
 	return 0;
 }
 
-int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
-			  uint32_t buf_num, uint32_t buf_len)
+static int _rtlsdr_submit_transfers(rtlsdr_dev_t *dev,
+				    libusb_transfer_cb_fn callback)
 {
 	unsigned int i;
 	int r = 0;
-	struct timeval tv = { 1, 0 };
-	struct timeval zerotv = { 0, 0 };
-	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
-
-	if (!dev)
-		return -1;
-
-	if (RTLSDR_INACTIVE != dev->async_status)
-		return -2;
-
-	dev->async_status = RTLSDR_RUNNING;
-	dev->async_cancel = 0;
-
-	dev->cb = cb;
-	dev->cb_ctx = ctx;
-
-	if (buf_num > 0)
-		dev->xfer_buf_num = buf_num;
-	else
-		dev->xfer_buf_num = DEFAULT_BUF_NUMBER;
-
-	if (buf_len > 0 && buf_len % 512 == 0) /* len must be multiple of 512 */
-		dev->xfer_buf_len = buf_len;
-	else
-		dev->xfer_buf_len = DEFAULT_BUF_LENGTH;
-
-	_rtlsdr_alloc_async_buffers(dev);
 
 	for(i = 0; i < dev->xfer_buf_num; ++i) {
 		libusb_fill_bulk_transfer(dev->xfer[i],
@@ -1902,7 +2418,7 @@ int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
 					  0x81,
 					  dev->xfer_buf[i],
 					  dev->xfer_buf_len,
-					  _libusb_callback,
+					  callback,
 					  (void *)dev,
 					  BULK_TIMEOUT);
 
@@ -1914,11 +2430,279 @@ int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
 					"following command:\n"
 					"echo 0 > /sys/module/usbcore"
 					"/parameters/usbfs_memory_mb\n", i);
-			dev->async_status = RTLSDR_CANCELING;
 			break;
 		}
+
+		dev->xfer_pending++;
+	}
+
+	return r;
+}
+
+/* cancel all transfers, wait for them to complete and free them */
+static void _rtlsdr_reap_transfers(rtlsdr_dev_t *dev)
+{
+	struct timeval tv = { 0, 100000 };
+	unsigned int i;
+
+	for (i = 0; i < dev->xfer_buf_num; ++i) {
+		if (dev->xfer[i])
+			libusb_cancel_transfer(dev->xfer[i]);
+	}
+
+	for (i = 0; dev->xfer_pending > 0 && i < 50; ++i)
+		libusb_handle_events_timeout_completed(dev->ctx, &tv, NULL);
+
+	_rtlsdr_free_async_buffers(dev);
+}
+
+/*
+ * Called from the event loop of rtlsdr_read_async() after the device was
+ * lost: waits for a device with the same serial number to reappear, brings
+ * it back into the state the lost one was in and restarts the transfers.
+ */
+static int _rtlsdr_reopen(rtlsdr_dev_t *dev)
+{
+	uint64_t lost = _rtlsdr_time_ms();
+	unsigned int i;
+	int r;
+
+	_rtlsdr_reap_transfers(dev);
+
+	libusb_release_interface(dev->devh, 0);
+	libusb_close(dev->devh);
+	dev->devh = NULL;
+
+	while (!dev->async_cancel) {
+		if (!rtlsdr_open_usb(dev, dev->index,
+				     dev->serial[0] ? dev->serial : NULL))
+			break;
+		/* control calls of other threads are waiting on ctrl_lock */
+		if (dev->reconnect_timeout &&
+		    _rtlsdr_time_ms() - lost >= dev->reconnect_timeout) {
+			fprintf(stderr, "Device not back after %u ms, giving up\n",
+				dev->reconnect_timeout);
+			break;
+		}
+#ifdef _WIN32
+		Sleep(250);
+#else
+		usleep(250000);
+#endif
+	}
+
+	if (!dev->devh)
+		return -1;
+
+	dev->dev_lost = 0;
+	dev->xfer_errors = 0;
+
+	/* without a serial number this may be another dongle, calibrate again */
+	if (!dev->serial[0])
+		dev->r82xx_p.fil_cal_valid = 0;
+
+	rtlsdr_init_baseband(dev);
+
+	rtlsdr_set_i2c_repeater(dev, 1);
+	rtlsdr_init_tuner(dev);
+	rtlsdr_set_i2c_repeater(dev, 0);
+
+	/* restore the settings of the lost device */
+	if (dev->direct_sampling)
+		rtlsdr_set_direct_sampling(dev, dev->direct_sampling);
+
+	rtlsdr_set_sample_freq_correction(dev, dev->corr);
+
+	if (dev->req_rate)
+		rtlsdr_set_sample_rate(dev, dev->req_rate);
+
+	if (dev->agc_mode)
+		rtlsdr_set_agc_mode(dev, dev->agc_mode);
+
+	rtlsdr_set_tuner_gain_mode(dev, dev->manual_gain);
+	if (dev->manual_gain)
+		rtlsdr_set_tuner_gain(dev, dev->gain);
+
+	for (i = 0; i < 8; ++i) {
+		if (dev->bias_tee_gpios & (1 << i))
+			rtlsdr_set_bias_tee_gpio(dev, i, 1);
 	}
 
+	if (dev->freq)
+		rtlsdr_set_center_freq(dev, dev->freq);
+
+	rtlsdr_reset_buffer(dev);
+
+	_rtlsdr_alloc_async_buffers(dev);
+
+	r = _rtlsdr_submit_transfers(dev, dev->burst ? _libusb_burst_callback :
+						 _libusb_callback);
+	if (r < 0)
+		return r;
+
+	dev->gap_ms = (uint32_t)(_rtlsdr_time_ms() - lost);
+	dev->discontinuities++;
+
+	fprintf(stderr, "Reconnected after %u ms\n", dev->gap_ms);
+
+	return 0;
+}
+
+static int _rtlsdr_reconnect(rtlsdr_dev_t *dev)
+{
+	int r;
+
+	fprintf(stderr, "Device lost, trying to reconnect...\n");
+
+	/* control calls from other threads (a retune worker, say) wait until
+	 * the device is back and in its old state again */
+	pthread_mutex_lock(&dev->ctrl_lock);
+	r = _rtlsdr_reopen(dev);
+	pthread_mutex_unlock(&dev->ctrl_lock);
+
+	return r;
+}
+
+int rtlsdr_set_latency_target(rtlsdr_dev_t *dev, uint32_t usec)
+{
+	uint32_t buf_num, buf_len = 0;
+
+	if (!dev)
+		return -1;
+
+	dev->latency_target = usec;
+
+	return rtlsdr_get_latency_buffers(dev, &buf_num, &buf_len);
+}
+
+int rtlsdr_get_latency_buffers(rtlsdr_dev_t *dev, uint32_t *buf_num,
+			       uint32_t *buf_len)
+{
+	uint64_t bytes;
+	uint32_t num, len;
+
+	if (!dev || !buf_num || !buf_len)
+		return -1;
+
+	if (!dev->rate)
+		return -2;
+
+	len = *buf_len;
+	if (len % MIN_BUF_LENGTH)
+		return -EINVAL;
+
+	if (dev->latency_target) {
+		bytes = (uint64_t)dev->rate * 2 * dev->latency_target / 1000000;
+
+		/* aim for four transfers in flight, enough to ride out
+		 * scheduling hiccups without padding the pipeline */
+		if (!len) {
+			len = (bytes / 4) & ~(MIN_BUF_LENGTH - 1);
+			if (len < MIN_BUF_LENGTH)
+				len = MIN_BUF_LENGTH;
+			if (len > DEFAULT_BUF_LENGTH)
+				len = DEFAULT_BUF_LENGTH;
+		}
+
+		num = (bytes + len / 2) / len;
+		if (num < MIN_BUF_NUMBER)
+			num = MIN_BUF_NUMBER;
+		if (num > USBFS_MEMORY_LIMIT / len)
+			num = USBFS_MEMORY_LIMIT / len;
+	} else {
+		if (!len)
+			len = DEFAULT_BUF_LENGTH;
+		num = DEFAULT_BUF_NUMBER;
+	}
+
+	*buf_num = num;
+	*buf_len = len;
+
+	/* the pipeline holds up to buf_num full transfers */
+	return (int)((uint64_t)num * len * 1000000 / 2 / dev->rate);
+}
+
+int rtlsdr_set_zerocopy(rtlsdr_dev_t *dev, int on)
+{
+	if (!dev)
+		return -1;
+
+#if defined(ENABLE_ZEROCOPY) && defined (__linux__) && LIBUSB_API_VERSION >= 0x01000105
+	dev->zerocopy = on;
+
+	return 0;
+#else
+	dev->zerocopy = 0;
+
+	return on ? -2 : 0;
+#endif
+}
+
+int rtlsdr_get_zerocopy(rtlsdr_dev_t *dev)
+{
+	if (!dev)
+		return -1;
+
+	return dev->use_zerocopy;
+}
+
+/* size, allocate and submit the transfers for streaming */
+static void _rtlsdr_start_transfers(rtlsdr_dev_t *dev, uint32_t buf_num,
+				    uint32_t buf_len)
+{
+	/* size the buffers not given by the caller for the latency target */
+	if (dev->latency_target && dev->rate && (!buf_num || !buf_len)) {
+		uint32_t num, len = buf_len;
+
+		if (rtlsdr_get_latency_buffers(dev, &num, &len) >= 0) {
+			if (!buf_num)
+				buf_num = num;
+			buf_len = len;
+		}
+	}
+
+	if (buf_num > 0)
+		dev->xfer_buf_num = buf_num;
+	else
+		dev->xfer_buf_num = DEFAULT_BUF_NUMBER;
+
+	if (buf_len > 0 && buf_len % 512 == 0) /* len must be multiple of 512 */
+		dev->xfer_buf_len = buf_len;
+	else
+		dev->xfer_buf_len = DEFAULT_BUF_LENGTH;
+
+	dev->xfer_pending = 0;
+	dev->sample_count = 0;
+
+	_rtlsdr_alloc_async_buffers(dev);
+
+	if (_rtlsdr_submit_transfers(dev, _libusb_callback) < 0)
+		dev->async_status = RTLSDR_CANCELING;
+}
+
+int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
+			  uint32_t buf_num, uint32_t buf_len)
+{
+	unsigned int i;
+	int r = 0;
+	struct timeval tv = { 1, 0 };
+	struct timeval zerotv = { 0, 0 };
+	enum rtlsdr_async_status next_status = RTLSDR_INACTIVE;
+
+	if (!dev)
+		return -1;
+
+	if (RTLSDR_INACTIVE != dev->async_status || dev->burst)
+		return -2;
+
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
+
+	dev->cb = cb;
+	dev->cb_ctx = ctx;
+
+	_rtlsdr_start_transfers(dev, buf_num, buf_len);
+
 	while (RTLSDR_INACTIVE != dev->async_status) {
 		r = libusb_handle_events_timeout_completed(dev->ctx, &tv,
 							   &dev->async_cancel);
@@ -1931,6 +2715,9 @@ int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
 
 		/* Check if device was lost due to transfer errors */
 		if (dev->dev_lost && RTLSDR_RUNNING == dev->async_status) {
+			if (dev->auto_reconnect && !_rtlsdr_reconnect(dev))
+				continue;
+
 			dev->async_status = RTLSDR_CANCELING;
 		}
 
@@ -1983,6 +2770,135 @@ int rtlsdr_read_async(rtlsdr_dev_t *dev, rtlsdr_read_async_cb_t cb, void *ctx,
 	return r;
 }
 
+static void LIBUSB_CALL _libusb_burst_callback(struct libusb_transfer *xfer)
+{
+	rtlsdr_dev_t *dev = (rtlsdr_dev_t *)xfer->user_data;
+	unsigned char *buf = xfer->buffer;
+	uint32_t len = xfer->actual_length;
+	uint32_t n;
+
+	if (LIBUSB_TRANSFER_COMPLETED != xfer->status) {
+		dev->xfer_pending--;
+		if (LIBUSB_TRANSFER_CANCELLED != xfer->status)
+			dev->dev_lost = 1;
+		return;
+	}
+
+	/* drop data from before the last retune and settling samples */
+	n = min(len, dev->burst_skip);
+	dev->burst_skip -= n;
+	buf += n;
+	len -= n;
+
+	n = min(len, dev->burst_left);
+	if (n) {
+		memcpy(dev->burst_dst, buf, n);
+		dev->burst_dst += n;
+		dev->burst_left -= n;
+	}
+
+	/* keep the transfer queued for the next burst */
+	if (libusb_submit_transfer(xfer) < 0)
+		dev->xfer_pending--;
+}
+
+static int _rtlsdr_start_burst(rtlsdr_dev_t *dev)
+{
+	uint32_t buf_len = BURST_BUF_LENGTH;
+	int r;
+
+	dev->xfer_buf_num = BURST_BUF_NUMBER;
+	if (dev->latency_target)
+		rtlsdr_get_latency_buffers(dev, &dev->xfer_buf_num, &buf_len);
+	dev->xfer_buf_len = buf_len;
+
+	dev->async_status = RTLSDR_RUNNING;
+	dev->async_cancel = 0;
+	dev->xfer_pending = 0;
+	dev->burst = 1;
+
+	r = _rtlsdr_alloc_async_buffers(dev);
+	if (r >= 0)
+		r = _rtlsdr_submit_transfers(dev, _libusb_burst_callback);
+
+	return r;
+}
+
+static void _rtlsdr_stop_burst(rtlsdr_dev_t *dev)
+{
+	_rtlsdr_reap_transfers(dev);
+
+	dev->burst = 0;
+	dev->async_status = RTLSDR_INACTIVE;
+}
+
+int rtlsdr_capture_burst(rtlsdr_dev_t *dev, uint32_t freq,
+			 uint32_t skip_samples, uint8_t *buf, uint32_t n_samples)
+{
+	struct timeval tv = { 1, 0 };
+	int r = 0;
+
+	if (!dev || !buf)
+		return -1;
+
+	if (!dev->burst) {
+		if (RTLSDR_INACTIVE != dev->async_status)
+			return -2;
+
+		r = _rtlsdr_start_burst(dev);
+		if (r < 0) {
+			_rtlsdr_stop_burst(dev);
+			return r;
+		}
+	}
+
+	if (freq != dev->freq) {
+		r = rtlsdr_set_center_freq(dev, freq);
+		if (r < 0) {
+			_rtlsdr_stop_burst(dev);
+			return r;
+		}
+
+		/* everything in flight was sampled before the retune */
+		dev->burst_skip = dev->xfer_buf_num * dev->xfer_buf_len +
+				  EPA_FIFO_LENGTH + 2 * skip_samples;
+	}
+
+	dev->burst_dst = buf;
+	dev->burst_left = 2 * n_samples;
+
+	while (dev->burst_left) {
+		r = libusb_handle_events_timeout_completed(dev->ctx, &tv,
+							   &dev->async_cancel);
+		if (r < 0 && r != LIBUSB_ERROR_INTERRUPTED)
+			break;
+
+		r = 0;
+		if (dev->dev_lost && dev->auto_reconnect && !dev->async_cancel &&
+		    !_rtlsdr_reconnect(dev)) {
+			/* what was captured so far is from before the gap */
+			dev->burst_dst = buf;
+			dev->burst_left = 2 * n_samples;
+			dev->burst_skip = dev->xfer_buf_num * dev->xfer_buf_len +
+					  EPA_FIFO_LENGTH + 2 * skip_samples;
+			continue;
+		}
+		if (dev->dev_lost || dev->async_cancel || !dev->xfer_pending) {
+			r = -1;
+			break;
+		}
+	}
+
+	dev->burst_dst = NULL;
+	dev->burst_left = 0;
+
+	/* the next call starts over, or fails for good if the device is gone */
+	if (r < 0)
+		_rtlsdr_stop_burst(dev);
+
+	return r;
+}
+
 int rtlsdr_cancel_async(rtlsdr_dev_t *dev)
 {
 	if (!dev)
@@ -2005,6 +2921,209 @@ int rtlsdr_cancel_async(rtlsdr_dev_t *dev)
 	return -2;
 }
 
+int rtlsdr_set_auto_reconnect(rtlsdr_dev_t *dev, int on)
+{
+	if (!dev)
+		return -1;
+
+	dev->auto_reconnect = on;
+
+	return 0;
+}
+
+int rtlsdr_set_reconnect_timeout(rtlsdr_dev_t *dev, uint32_t ms)
+{
+	if (!dev)
+		return -1;
+
+	dev->reconnect_timeout = ms;
+
+	return 0;
+}
+
+uint32_t rtlsdr_get_discontinuities(rtlsdr_dev_t *dev, uint32_t *gap_ms)
+{
+	if (!dev)
+		return 0;
+
+	if (gap_ms)
+		*gap_ms = dev->gap_ms;
+
+	return dev->discontinuities;
+}
+
+int rtlsdr_get_open_timing(rtlsdr_dev_t *dev, uint32_t *usb_us,
+			   uint32_t *baseband_us, uint32_t *probe_us,
+			   uint32_t *tuner_us)
+{
+	if (!dev)
+		return -1;
+
+	if (usb_us)
+		*usb_us = dev->open_usb_us;
+	if (baseband_us)
+		*baseband_us = dev->open_baseband_us;
+	if (probe_us)
+		*probe_us = dev->open_probe_us;
+	if (tuner_us)
+		*tuner_us = dev->open_tuner_us;
+
+	return 0;
+}
+
+int rtlsdr_group_create(rtlsdr_group_t **out_grp)
+{
+	rtlsdr_group_t *grp;
+
+	if (!out_grp)
+		return -1;
+
+	grp = malloc(sizeof(rtlsdr_group_t));
+	if (NULL == grp)
+		return -ENOMEM;
+
+	memset(grp, 0, sizeof(rtlsdr_group_t));
+
+	if (libusb_init(&grp->ctx) < 0) {
+		free(grp);
+		return -1;
+	}
+
+	*out_grp = grp;
+
+	return 0;
+}
+
+int rtlsdr_group_open(rtlsdr_group_t *grp, rtlsdr_dev_t **out_dev,
+		      uint32_t index, rtlsdr_group_cb_t cb, void *ctx)
+{
+	rtlsdr_dev_t *dev = NULL;
+	int r;
+
+	if (!grp || !out_dev)
+		return -1;
+
+	if (grp->running)
+		return -2;
+
+	if (grp->dev_count >= GROUP_MAX_DEVICES)
+		return -ENOMEM;
+
+	r = _rtlsdr_open(&dev, index, grp);
+	if (r < 0)
+		return r;
+
+	dev->group_cb = cb;
+	dev->group_ctx = ctx;
+	grp->dev[grp->dev_count++] = dev;
+
+	*out_dev = dev;
+
+	return 0;
+}
+
+int rtlsdr_group_read_async(rtlsdr_group_t *grp, uint32_t buf_num,
+			    uint32_t buf_len)
+{
+	struct timeval tv = { 1, 0 };
+	rtlsdr_dev_t *dev;
+	uint32_t i, active;
+	int r = 0;
+
+	if (!grp || !grp->dev_count)
+		return -1;
+
+	if (grp->running)
+		return -2;
+
+	for (i = 0; i < grp->dev_count; i++) {
+		if (RTLSDR_INACTIVE != grp->dev[i]->async_status)
+			return -2;
+	}
+
+	grp->running = 1;
+	grp->cancel = 0;
+
+	for (i = 0; i < grp->dev_count; i++) {
+		dev = grp->dev[i];
+		dev->async_status = RTLSDR_RUNNING;
+		dev->async_cancel = 0;
+		dev->cb = NULL;
+		_rtlsdr_start_transfers(dev, buf_num, buf_len);
+	}
+
+	active = grp->dev_count;
+
+	while (active && !grp->cancel) {
+		r = libusb_handle_events_timeout_completed(grp->ctx, &tv,
+							   &grp->cancel);
+		if (r < 0) {
+			if (r == LIBUSB_ERROR_INTERRUPTED) /* stray signal */
+				continue;
+			break;
+		}
+
+		/* stop lost or canceled devices, the others keep running */
+		for (i = 0; i < grp->dev_count; i++) {
+			dev = grp->dev[i];
+
+			if (RTLSDR_INACTIVE == dev->async_status)
+				continue;
+
+			if (dev->dev_lost ||
+			    RTLSDR_CANCELING == dev->async_status) {
+				_rtlsdr_reap_transfers(dev);
+				dev->async_status = RTLSDR_INACTIVE;
+				active--;
+			}
+		}
+	}
+
+	for (i = 0; i < grp->dev_count; i++) {
+		dev = grp->dev[i];
+
+		if (RTLSDR_INACTIVE != dev->async_status) {
+			_rtlsdr_reap_transfers(dev);
+			dev->async_status = RTLSDR_INACTIVE;
+		}
+	}
+
+	grp->running = 0;
+
+	return r < 0 ? r : 0;
+}
+
+int rtlsdr_group_cancel_async(rtlsdr_group_t *grp)
+{
+	if (!grp)
+		return -1;
+
+	if (!grp->running)
+		return -2;
+
+	grp->cancel = 1;
+
+	return 0;
+}
+
+int rtlsdr_group_destroy(rtlsdr_group_t *grp)
+{
+	if (!grp)
+		return -1;
+
+	if (grp->running)
+		return -2;
+
+	/* rtlsdr_close() removes the device from the group */
+	while (grp->dev_count)
+		rtlsdr_close(grp->dev[0]);
+
+	libusb_exit(grp->ctx);
+	free(grp);
+
+	return 0;
+}
+
 uint32_t rtlsdr_get_tuner_clock(void *dev)
 {
 	uint32_t tuner_freq;
@@ -2043,6 +3162,11 @@ int rtlsdr_set_bias_tee_gpio(rtlsdr_dev_t *dev, int gpio, int on)
 	rtlsdr_set_gpio_output(dev, gpio);
 	rtlsdr_set_gpio_bit(dev, gpio, on);
 
+	if (on)
+		dev->bias_tee_gpios |= 1 << gpio;
+	else
+		dev->bias_tee_gpios &= ~(1 << gpio);
+
 	return 0;
 }
 
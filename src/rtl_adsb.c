@@ -470,11 +470,8 @@ int main(int argc, char **argv)
 	verbose_ppm_set(dev, ppm_error);
 	r = rtlsdr_set_agc_mode(dev, 1);
 
-	/* Set the tuner frequency */
-	verbose_set_frequency(dev, ADSB_FREQ);
-
-	/* Set the sample rate */
-	verbose_set_sample_rate(dev, ADSB_RATE);
+	/* Set the sample rate and the tuner frequency */
+	verbose_set_sample_rate_and_frequency(dev, ADSB_RATE, ADSB_FREQ);
 
 	rtlsdr_set_bias_tee(dev, enable_biastee);
 	if (enable_biastee)
@@ -69,11 +69,22 @@
 #endif
 
 #include <math.h>
+#include <float.h>
+#include <time.h>
 #include <pthread.h>
 #include <libusb.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
 #include "rtl-sdr.h"
 #include "convenience/convenience.h"
+#include "dsp/dsp.h"
 
 #define DEFAULT_SAMPLE_RATE		24000
 #define DEFAULT_BUF_LENGTH		(1 * 16384)
@@ -83,6 +94,19 @@
 #define BUFFER_DUMP			4096
 
 #define FREQUENCIES_LIMIT		1000
+#define QUEUE_DEPTH			8
+#define ARENA_ALIGN			64	/* every buffer on its own cache lines */
+#define END_OF_STREAM			-1	/* queued length after the last -I buffer */
+
+#define CHANNELS_LIMIT			64
+#define CHAN_TAPS			12	/* prototype taps per filter bank branch */
+#define CHAN_CHUNK			16384	/* capture samples per worker buffer */
+#define CHAN_MIN_DOWNSAMPLE		4
+#define CHAN_MAX_DOWNSAMPLE		64
+#define MAXIMUM_CAPTURE_RATE		2560000
+#define SCAN_FRAMES			8	/* ffts averaged per occupancy check */
+#define RESAMPLE_TAPS			32	/* taps per phase, per unit of decimation */
+#define RESAMPLE_MAX_PHASES		1024
 
 static volatile int do_exit = 0;
 static int lcm_post[17] = {1,1,1,3,1,5,3,7,1,9,5,11,3,13,7,15,1};
@@ -92,6 +116,62 @@ static int *atan_lut = NULL;
 static int atan_lut_size = 131072; /* 512 KB */
 static int atan_lut_coef = 8;
 
+/*
+ * Bounded queue of preallocated buffers between two threads.  The producer
+ * fills the next free buffer in place and queues it, the consumer works on
+ * the oldest one in place and then releases it.  Buffers arriving while
+ * the consumer is QUEUE_DEPTH buffers behind are dropped.
+ */
+struct buf_queue
+{
+	int16_t  *buf[QUEUE_DEPTH];
+	int      len[QUEUE_DEPTH];
+	int      size;     /* capacity of each buffer */
+	int      head, count;
+	int      block;    /* wait for a free buffer instead of dropping */
+	uint32_t queued;
+	uint32_t late;     /* had to wait for the consumer */
+	uint32_t dropped;  /* the queue was full */
+	pthread_mutex_t m;
+	pthread_cond_t ready;
+	pthread_cond_t space;
+};
+
+/*
+ * The sample buffers of all stages, carved out of a single block that is
+ * sized once the capture and decimation settings are known.  There is no
+ * freeing of single buffers, the arena goes as a whole.
+ */
+struct arena
+{
+	char     *mem;     /* as returned by malloc() */
+	char     *base;    /* mem rounded up to ARENA_ALIGN */
+	size_t   size, used;
+};
+
+/* -Z: time spent in front_end() and each stage of full_demod() */
+#define STATS_PERIOD 10           /* seconds between reports */
+#define STAGE_BUCKETS 16          /* per buffer histogram, bucket b is < 2^b us */
+
+enum demod_stage {STAGE_FRONT_END, STAGE_CIC, STAGE_SQUELCH, STAGE_DEMOD,
+	STAGE_POST_LPF, STAGE_DEEMPH, STAGE_DC_BLOCK, STAGE_RESAMPLE, STAGES};
+
+struct stage_stats
+{
+	uint64_t ns, ns_max;
+	uint32_t buffers;
+	uint32_t hist[STAGE_BUCKETS];
+};
+
+/* only touched by the demod thread or channel worker until it has exited */
+struct demod_stats
+{
+	uint32_t freq;            /* channel, 0 for the single demod */
+	uint64_t last_ns;         /* of the previous report */
+	uint64_t samples;         /* into full_demod(), since then */
+	struct stage_stats stage[STAGES];
+};
+
 struct dongle_state
 {
 	int      exit_flag;
@@ -101,26 +181,49 @@ struct dongle_state
 	uint32_t freq;
 	uint32_t rate;
 	int      gain;
-	uint16_t buf16[MAXIMUM_BUF_LENGTH];
 	uint32_t buf_len;
 	int      ppm_error;
 	int      offset_tuning;
 	int      direct_sampling;
+	char     *fir_profile;
 	int      mute;
+	struct stage_stats front;  /* front_end(), until handed over */
 	struct demod_state *demod_target;
 };
 
+/*
+ * Rational polyphase resampler, rate * up / down.  The prototype is a
+ * kaiser windowed sinc of up * taps coefficients, split into up phases
+ * of taps each, stored time reversed so every output is one dot product
+ * over the history.
+ */
+struct resampler
+{
+	int      up, down;
+	int      taps;           /* per phase, a multiple of 8 */
+	int      pos;            /* next output, in input samples * up */
+	float    *bank;
+	float    *hist;          /* taps-1 old samples, then the new ones */
+};
+
+struct stats_output
+{
+	char     *filename;
+	FILE     *file;           /* NULL while -Z is off */
+	pthread_mutex_t m;        /* one report at a time, guards front */
+	struct stage_stats front; /* handed over by the usb callback */
+};
+
 struct demod_state
 {
 	int      exit_flag;
 	pthread_t thread;
-	int16_t  lowpassed[MAXIMUM_BUF_LENGTH];
+	struct buf_queue queue;
+	int16_t  *lowpassed;  /* buffer taken from the queue */
 	int      lp_len;
-	int16_t  lp_i_hist[10][6];
-	int16_t  lp_q_hist[10][6];
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int16_t  droop_i_hist[9];
-	int16_t  droop_q_hist[9];
+	int16_t  *result;     /* free buffer of the output queue */
+	int16_t  *result_drop;
+	int      result_size; /* capacity of result and result_drop */
 	int      result_len;
 	int      rate_in;
 	int      rate_out;
@@ -132,32 +235,41 @@ struct demod_state
 	int      post_downsample;
 	int      output_scale;
 	int      squelch_level, conseq_squelch, squelch_hits, terminate_on_squelch;
+	uint32_t demodded;      /* buffers through full_demod(), for scan_check() */
 	int      downsample_passes;
 	int      comp_fir_size;
+	struct dsp_cic cic;
 	int      custom_atan;
-	int      deemph, deemph_a;
-	int      now_lpr;
-	int      prev_lpr_index;
+	int      deemph, deemph_a, deemph_avg;
+	struct resampler resamp;  /* rate_out to rate_out2 */
 	int      dc_block, dc_avg;
+	int      nco_on;        /* scan: shift the channel to dc, no rotate_90 */
+	float    nco_r, nco_j, nco_step_r, nco_step_j;
 	void     (*mode_demod)(struct demod_state*);
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
+	struct demod_stats stats;
 	struct output_state *output_target;
 };
 
+/* -I: cu8 samples from a file instead of the dongle, at full speed */
+struct input_state
+{
+	char     *filename;
+	FILE     *file;
+	uint32_t rate;            /* of the recording, 0 = what rtl_fm would tune */
+	uint64_t samples;
+	uint64_t start_ns, end_ns;  /* end_ns is set once the last sample is out */
+	/* time spent in each thread's stage */
+	uint64_t front_ns, demod_ns, output_ns;
+};
+
 struct output_state
 {
 	int      exit_flag;
 	pthread_t thread;
 	FILE     *file;
 	char     *filename;
-	int16_t  result[MAXIMUM_BUF_LENGTH];
-	int      result_len;
+	struct buf_queue queue;
 	int      rate;
-	pthread_rwlock_t rw;
-	pthread_cond_t ready;
-	pthread_mutex_t ready_m;
 };
 
 struct controller_state
@@ -169,15 +281,93 @@ struct controller_state
 	int      freq_now;
 	int      edge;
 	int      wb_mode;
+	/* scan list grouped into windows that fit in one capture */
+	int      win_len;
+	int      win_now;
+	int      win_of[FREQUENCIES_LIMIT];
+	uint32_t win_tune[FREQUENCIES_LIMIT];
+	int      hop_req;       /* under hop_m */
 	pthread_cond_t hop;
 	pthread_mutex_t hop_m;
 };
 
+/* complex float fft, interleaved re/im in buf */
+struct fft_state
+{
+	int      n;
+	float    *buf;
+	float    *twiddle;
+	int      *rev;
+};
+
+/* fft occupancy check of the scan window, run by the usb callback */
+struct scan_state
+{
+	int      win_applied;     /* window the nco was last set up for */
+	int      hop_pending;
+	uint32_t select_at;       /* buffers queued for the demod before the
+				   * channel last changed */
+	int      frames;
+	float    *hann;
+	float    hann_sq;         /* sum of hann^2 */
+	float    *power;
+	struct fft_state fft;
+};
+
+/*
+ * Polyphase filter bank: the capture is split into bins channels of
+ * rate/bins Hz, each 2x oversampled (blocks of bins/2 capture samples).
+ * Every requested frequency takes the nearest bin, is shifted by its
+ * residual offset from the bin centre and then runs the usual demod
+ * chain with its own demod_state and output file.
+ */
+struct channel
+{
+	uint32_t freq;
+	int      bin;
+	float    nco_r, nco_j;    /* residual offset from the bin centre */
+	float    step_r, step_j;
+	char     *filename;
+	FILE     *file;
+	struct demod_state demod;
+};
+
+struct chan_worker
+{
+	pthread_t thread;
+	int      first, count;    /* channels first .. first+count-1 */
+	struct buf_queue queue;
+};
+
+struct channelizer_state
+{
+	pthread_t thread;
+	int      workers;         /* 0 = off */
+	int      count;
+	int      bins;            /* fft size */
+	int      taps;            /* prototype length, bins * CHAN_TAPS */
+	int      downsample;      /* per channel, after the filter bank */
+	int      seg_len;         /* int16 per channel in a worker buffer */
+	float    scale;
+	float    *proto;
+	float    *x;              /* complex capture, taps-1 samples of history */
+	int      x_len, next_t;
+	struct fft_state fft;
+	uint32_t block;
+	struct channel *chan;
+	struct chan_worker *worker;
+};
+
 // multiple of these, eventually
+struct arena arena;
 struct dongle_state dongle;
+struct input_state input;
 struct demod_state demod;
 struct output_state output;
 struct controller_state controller;
+struct channelizer_state channelizer;
+struct scan_state scan;
+struct stats_output stats_out;
 
 void usage(void)
 {
@@ -186,10 +376,11 @@ void usage(void)
 		"Use:\trtl_fm -f freq [-options] [filename]\n"
 		"\t-f frequency_to_tune_to [Hz]\n"
 		"\t    use multiple -f for scanning (requires squelch)\n"
+		"\t    channels that fit in one capture are scanned without retuning\n"
 		"\t    ranges supported, -f 118M:137M:25k\n"
 		"\t[-M modulation (default: fm)]\n"
 		"\t    fm, wbfm, raw, am, usb, lsb\n"
-		"\t    wbfm == -M fm -s 170k -o 4 -A fast -r 32k -l 0 -E deemp\n"
+		"\t    wbfm == -M fm -s 170k -o 4 -A poly -r 32k -l 0 -E deemp\n"
 		"\t    raw mode outputs 2x16 bit IQ pairs\n"
 		"\t[-s sample_rate (default: 24k)]\n"
 		"\t[-d device_index or serial (default: 0)]\n"
@@ -208,15 +399,33 @@ void usage(void)
 		"\t    direct2: enable direct sampling 2 (usually Q)\n"
 		"\t    offset:  enable offset tuning\n"
 		"\tfilename ('-' means stdout)\n"
-		"\t    omitting the filename also uses stdout\n\n"
+		"\t    omitting the filename also uses stdout\n"
+		"\t[-I input_file ('-' means stdin)]\n"
+		"\t    demodulate a cu8 IQ recording as fast as possible,\n"
+		"\t    reports the throughput at exit, -f is optional\n"
+		"\t[-S input_sample_rate (default: what rtl_fm would tune)]\n"
+		"\t    must be a multiple of -s, a power of two for -F\n\n"
 		"Experimental options:\n"
 		"\t[-r resample_rate (default: none / same as -s)]\n"
+		"\t    polyphase, any rate with a common factor with -s\n"
 		"\t[-t squelch_delay (default: 10)]\n"
 		"\t    +values will mute/scan, -values will exit\n"
 		"\t[-F fir_size (default: off)]\n"
 		"\t    enables low-leakage downsample filter\n"
 		"\t    size can be 0 or 9.  0 has bad roll off\n"
-		"\t[-A std/fast/lut choose atan math (default: std)]\n"
+		"\t[-A std/fast/lut/poly choose atan math (default: std)]\n"
+		"\t    poly: vectorized polynomial, as accurate as std\n"
+		"\t[-B benchmark the atan math, front end, cic and resampler, then exit]\n"
+		"\t[-Z stats_file ('-' means stderr)]\n"
+		"\t    per stage demod timing every 10 s and at exit,\n"
+		"\t    one line per stage with a per buffer histogram,\n"
+		"\t    ns_per_sample is per sample out of the front end\n"
+		"\t[-c demod FIR profile: default, wide, narrow (default: default)]\n"
+		"\t    narrow: +/- 0.5 MHz passband, less aliasing at low rates\n"
+		"\t[-P worker_threads (default: off)]\n"
+		"\t    demodulate all -f frequencies at once from one capture\n"
+		"\t    with a polyphase filter bank, squelch is per channel,\n"
+		"\t    output goes to filename.<frequency> for each channel\n"
 		//"\t[-C clip_path (default: off)\n"
 		//"\t (create time stamped raw clips, requires squelch)\n"
 		//"\t (path must have '\%s' and will expand to date_time_freq)\n"
@@ -238,7 +447,8 @@ sighandler(int signum)
 	if (CTRL_C_EVENT == signum) {
 		fprintf(stderr, "Signal caught, exiting!\n");
 		do_exit = 1;
-		rtlsdr_cancel_async(dongle.dev);
+		if (dongle.dev) {
+			rtlsdr_cancel_async(dongle.dev);}
 		return TRUE;
 	}
 	return FALSE;
@@ -249,7 +459,8 @@ static void sighandler(int signum)
 	signal(SIGPIPE, SIG_IGN);
 	fprintf(stderr, "Signal caught, exiting!\n");
 	do_exit = 1;
-	rtlsdr_cancel_async(dongle.dev);
+	if (dongle.dev) {
+		rtlsdr_cancel_async(dongle.dev);}
 }
 #endif
 
@@ -257,22 +468,157 @@ static void sighandler(int signum)
 #define safe_cond_signal(n, m) pthread_mutex_lock(m); pthread_cond_signal(n); pthread_mutex_unlock(m)
 #define safe_cond_wait(n, m) pthread_mutex_lock(m); pthread_cond_wait(n, m); pthread_mutex_unlock(m)
 
-/* {length, coef, coef, coef}  and scaled by 2^15
-   for now, only length 9, optimal way to get +85% bandwidth */
-#define CIC_TABLE_MAX 10
-int cic_9_tables[][10] = {
-	{0,},
-	{9, -156,  -97, 2798, -15489, 61019, -15489, 2798,  -97, -156},
-	{9, -128, -568, 5593, -24125, 74126, -24125, 5593, -568, -128},
-	{9, -129, -639, 6187, -26281, 77511, -26281, 6187, -639, -129},
-	{9, -122, -612, 6082, -26353, 77818, -26353, 6082, -612, -122},
-	{9, -120, -602, 6015, -26269, 77757, -26269, 6015, -602, -120},
-	{9, -120, -582, 5951, -26128, 77542, -26128, 5951, -582, -120},
-	{9, -119, -580, 5931, -26094, 77505, -26094, 5931, -580, -119},
-	{9, -119, -578, 5921, -26077, 77484, -26077, 5921, -578, -119},
-	{9, -119, -577, 5917, -26067, 77473, -26067, 5917, -577, -119},
-	{9, -199, -362, 5303, -25505, 77489, -25505, 5303, -362, -199},
-};
+static size_t arena_round(size_t n)
+{
+	return (n + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+int arena_init(struct arena *a, size_t size)
+{
+	a->mem = malloc(size + ARENA_ALIGN);
+	if (!a->mem) {
+		return -1;}
+	a->base = (char *)(((uintptr_t)a->mem + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1));
+	a->size = size;
+	a->used = 0;
+	return 0;
+}
+
+/* n bytes aligned to ARENA_ALIGN, NULL when the arena is used up */
+void *arena_alloc(struct arena *a, size_t n)
+{
+	void *p;
+	n = arena_round(n);
+	if (a->used + n > a->size) {
+		return NULL;}
+	p = a->base + a->used;
+	a->used += n;
+	return p;
+}
+
+void arena_cleanup(struct arena *a)
+{
+	free(a->mem);
+	memset(a, 0, sizeof(*a));
+}
+
+void queue_init(struct buf_queue *q)
+{
+	memset(q, 0, sizeof(*q));
+	pthread_mutex_init(&q->m, NULL);
+	pthread_cond_init(&q->ready, NULL);
+	pthread_cond_init(&q->space, NULL);
+}
+
+/* arena bytes taken by queue_alloc() */
+static size_t queue_bytes(int buf_len)
+{
+	return QUEUE_DEPTH * arena_round(buf_len * sizeof(int16_t));
+}
+
+int queue_alloc(struct buf_queue *q, int buf_len, struct arena *a)
+{
+	int i;
+	for (i=0; i<QUEUE_DEPTH; i++) {
+		q->buf[i] = arena_alloc(a, buf_len * sizeof(int16_t));
+		if (!q->buf[i]) {
+			return -1;}
+	}
+	q->size = buf_len;
+	return 0;
+}
+
+void queue_cleanup(struct buf_queue *q)
+{
+	pthread_mutex_destroy(&q->m);
+	pthread_cond_destroy(&q->ready);
+	pthread_cond_destroy(&q->space);
+}
+
+/* next free buffer for the producer, NULL (and counted) if the queue is full,
+ * a blocking queue waits for the consumer instead */
+int16_t *queue_free_buf(struct buf_queue *q)
+{
+	int16_t *buf = NULL;
+	pthread_mutex_lock(&q->m);
+	while (q->block && q->count == QUEUE_DEPTH && !do_exit) {
+		pthread_cond_wait(&q->space, &q->m);}
+	if (q->count < QUEUE_DEPTH) {
+		buf = q->buf[(q->head + q->count) % QUEUE_DEPTH];
+	} else {
+		q->dropped++;}
+	pthread_mutex_unlock(&q->m);
+	return buf;
+}
+
+/* queue the buffer returned by queue_free_buf() */
+void queue_push(struct buf_queue *q, int len)
+{
+	pthread_mutex_lock(&q->m);
+	q->len[(q->head + q->count) % QUEUE_DEPTH] = len;
+	if (q->count) {
+		q->late++;}
+	q->count++;
+	q->queued++;
+	pthread_cond_signal(&q->ready);
+	pthread_mutex_unlock(&q->m);
+}
+
+/* oldest queued buffer, waits for one, NULL on exit */
+int16_t *queue_wait(struct buf_queue *q, int *len)
+{
+	int16_t *buf = NULL;
+	pthread_mutex_lock(&q->m);
+	while (!q->count && !do_exit) {
+		pthread_cond_wait(&q->ready, &q->m);}
+	if (q->count) {
+		buf = q->buf[q->head];
+		*len = q->len[q->head];
+	}
+	pthread_mutex_unlock(&q->m);
+	return buf;
+}
+
+/* hand the buffer returned by queue_wait() back to the producer */
+void queue_release(struct buf_queue *q)
+{
+	pthread_mutex_lock(&q->m);
+	q->head = (q->head + 1) % QUEUE_DEPTH;
+	q->count--;
+	pthread_cond_signal(&q->space);
+	pthread_mutex_unlock(&q->m);
+}
+
+void queue_wake(struct buf_queue *q)
+{
+	pthread_mutex_lock(&q->m);
+	pthread_cond_broadcast(&q->ready);
+	pthread_cond_broadcast(&q->space);
+	pthread_mutex_unlock(&q->m);
+}
+
+/* tell the consumer there is nothing more to come */
+void queue_end(struct buf_queue *q)
+{
+	if (queue_free_buf(q)) {
+		queue_push(q, END_OF_STREAM);}
+}
+
+static uint64_t time_ns(void)
+/* monotonic */
+{
+#ifdef _WIN32
+	LARGE_INTEGER freq, now;
+	QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&now);
+	return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000 +
+	       (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
 
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 double log2(double n)
@@ -302,26 +648,176 @@ void rotate_90(unsigned char *buf, uint32_t len)
 	}
 }
 
-void low_pass(struct demod_state *d)
-/* simple square window FIR */
+int low_pass(struct demod_state *d, const int16_t *in, int len, int16_t *out)
+/* simple square window FIR, out may be in, returns the output length */
 {
 	int i=0, i2=0;
-	while (i < d->lp_len) {
-		d->now_r += d->lowpassed[i];
-		d->now_j += d->lowpassed[i+1];
+	/* locals, so the sums stay in registers */
+	int now_r = d->now_r, now_j = d->now_j;
+	int prev_index = d->prev_index, downsample = d->downsample;
+	while (i < len) {
+		now_r += in[i];
+		now_j += in[i+1];
 		i += 2;
-		d->prev_index++;
-		if (d->prev_index < d->downsample) {
+		prev_index++;
+		if (prev_index < downsample) {
 			continue;
 		}
-		d->lowpassed[i2]   = d->now_r; // * d->output_scale;
-		d->lowpassed[i2+1] = d->now_j; // * d->output_scale;
-		d->prev_index = 0;
-		d->now_r = 0;
-		d->now_j = 0;
+		out[i2]   = now_r; // * d->output_scale;
+		out[i2+1] = now_j; // * d->output_scale;
+		prev_index = 0;
+		now_r = 0;
+		now_j = 0;
 		i2 += 2;
 	}
-	d->lp_len = i2;
+	d->now_r = now_r;
+	d->now_j = now_j;
+	d->prev_index = prev_index;
+	return i2;
+}
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+/*
+ * rotate_90() followed by the -127 bias, on bytes widened to int16:
+ * swap I/Q of the 2nd and 4th sample of each rotation period, then
+ * (x ^ -1) + 129 == (255 - x) - 127 for the negated bytes.
+ */
+static const int16_t rot_neg[8]  = {0, 0, -1, 0, -1, -1, 0, -1};
+static const int16_t rot_bias[8] = {-127, -127, 129, -127, 129, 129, -127, 129};
+#endif
+
+static void widen_rotate(const unsigned char *buf, int len, int rotate, int16_t *out)
+/* len a multiple of 8 */
+{
+	int i = 0;
+#if defined(__AVX2__)
+	__m256i neg = _mm256_setzero_si256();
+	__m256i bias = _mm256_set1_epi16(-127);
+	__m256i lo, hi;
+	if (rotate) {
+		neg = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)rot_neg));
+		bias = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)rot_bias));
+	}
+	for (; i + 32 <= len; i += 32) {
+		lo = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(buf + i)));
+		hi = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(buf + i + 16)));
+		if (rotate) {
+			lo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(lo, 0xb4), 0xb4);
+			hi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(hi, 0xb4), 0xb4);
+		}
+		_mm256_storeu_si256((__m256i *)(out + i),
+			_mm256_add_epi16(_mm256_xor_si256(lo, neg), bias));
+		_mm256_storeu_si256((__m256i *)(out + i + 16),
+			_mm256_add_epi16(_mm256_xor_si256(hi, neg), bias));
+	}
+#elif defined(__SSE2__)
+	__m128i zero = _mm_setzero_si128();
+	__m128i neg = zero;
+	__m128i bias = _mm_set1_epi16(-127);
+	__m128i b, lo, hi;
+	if (rotate) {
+		neg = _mm_loadu_si128((const __m128i *)rot_neg);
+		bias = _mm_loadu_si128((const __m128i *)rot_bias);
+	}
+	for (; i + 16 <= len; i += 16) {
+		b = _mm_loadu_si128((const __m128i *)(buf + i));
+		lo = _mm_unpacklo_epi8(b, zero);
+		hi = _mm_unpackhi_epi8(b, zero);
+		if (rotate) {
+			lo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, 0xb4), 0xb4);
+			hi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, 0xb4), 0xb4);
+		}
+		_mm_storeu_si128((__m128i *)(out + i),
+			_mm_add_epi16(_mm_xor_si128(lo, neg), bias));
+		_mm_storeu_si128((__m128i *)(out + i + 8),
+			_mm_add_epi16(_mm_xor_si128(hi, neg), bias));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	static const uint16_t swap_mask[8] = {0, 0, 0xffff, 0xffff, 0, 0, 0xffff, 0xffff};
+	uint16x8_t swap = vld1q_u16(swap_mask);
+	int16x8_t neg = vdupq_n_s16(0);
+	int16x8_t bias = vdupq_n_s16(-127);
+	int16x8_t lo, hi;
+	uint8x16_t b;
+	if (rotate) {
+		neg = vld1q_s16(rot_neg);
+		bias = vld1q_s16(rot_bias);
+	}
+	for (; i + 16 <= len; i += 16) {
+		b = vld1q_u8(buf + i);
+		lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(b)));
+		hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(b)));
+		if (rotate) {
+			lo = vbslq_s16(swap, vrev32q_s16(lo), lo);
+			hi = vbslq_s16(swap, vrev32q_s16(hi), hi);
+		}
+		vst1q_s16(out + i, vaddq_s16(veorq_s16(lo, neg), bias));
+		vst1q_s16(out + i + 8, vaddq_s16(veorq_s16(hi, neg), bias));
+	}
+#endif
+	if (!rotate) {
+		for (; i < len; i++) {
+			out[i] = (int16_t)buf[i] - 127;}
+		return;
+	}
+	/* 255 - x - 127 == 128 - x */
+	for (; i < len; i += 8) {
+		out[i]   = (int16_t)buf[i]   - 127;
+		out[i+1] = (int16_t)buf[i+1] - 127;
+		out[i+2] = 128 - (int16_t)buf[i+3];
+		out[i+3] = (int16_t)buf[i+2] - 127;
+		out[i+4] = 128 - (int16_t)buf[i+4];
+		out[i+5] = 128 - (int16_t)buf[i+5];
+		out[i+6] = (int16_t)buf[i+7] - 127;
+		out[i+7] = 128 - (int16_t)buf[i+6];
+	}
+}
+
+static void mix_nco(struct demod_state *d, int16_t *buf, int len)
+{
+	int i;
+	float x, y, t, mag;
+	float r = d->nco_r, j = d->nco_j;
+	for (i = 0; i < len; i += 2) {
+		x = buf[i];
+		y = buf[i+1];
+		buf[i]   = (int16_t)lrintf(x * r - y * j);
+		buf[i+1] = (int16_t)lrintf(x * j + y * r);
+		t = r * d->nco_step_r - j * d->nco_step_j;
+		j = r * d->nco_step_j + j * d->nco_step_r;
+		r = t;
+	}
+	mag = 1.0f / sqrtf(r * r + j * j);
+	d->nco_r = r * mag;
+	d->nco_j = j * mag;
+}
+
+#define FRONT_END_TILE		2048
+
+int front_end(struct demod_state *d, const unsigned char *buf, int len,
+	      int rotate, int16_t *out)
+/* rotate_90() or the scan nco, widening and low_pass() in one pass over
+ * the usb buffer, through a tile that stays in L1, returns the output length */
+{
+	int16_t tile[FRONT_END_TILE];
+	int i, n, out_len = 0;
+	if (d->downsample_passes) {
+		/* the CIC stages run in the demod thread */
+		widen_rotate(buf, len, rotate, out);
+		if (d->nco_on) {
+			mix_nco(d, out, len);}
+		return len;
+	}
+	for (i = 0; i < len; i += FRONT_END_TILE) {
+		n = len - i;
+		if (n > FRONT_END_TILE) {
+			n = FRONT_END_TILE;}
+		widen_rotate(buf + i, n, rotate, tile);
+		if (d->nco_on) {
+			mix_nco(d, tile, n);}
+		out_len += low_pass(d, tile, n, out + out_len);
+	}
+	return out_len;
 }
 
 int low_pass_simple(int16_t *signal2, int len, int step)
@@ -340,82 +836,153 @@ int low_pass_simple(int16_t *signal2, int len, int step)
 	return len / step;
 }
 
-void low_pass_real(struct demod_state *s)
-/* simple square window FIR */
-// add support for upsampling?
+static float dot_f32(const float *a, const float *b, int n)
+/* n a multiple of 8 */
 {
-	int i=0, i2=0;
-	int fast = (int)s->rate_out;
-	int slow = s->rate_out2;
-	while (i < s->result_len) {
-		s->now_lpr += s->result[i];
-		i++;
-		s->prev_lpr_index += slow;
-		if (s->prev_lpr_index < fast) {
-			continue;
-		}
-		s->result[i2] = (int16_t)(s->now_lpr / (fast/slow));
-		s->prev_lpr_index -= fast;
-		s->now_lpr = 0;
-		i2 += 1;
+	int i;
+	float sum;
+#if defined(__AVX2__)
+	__m256 acc = _mm256_setzero_ps();
+	__m128 h;
+	for (i = 0; i < n; i += 8) {
+		acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_loadu_ps(a + i),
+			_mm256_loadu_ps(b + i)));}
+	h = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+	h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+	h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+	sum = _mm_cvtss_f32(h);
+#elif defined(__SSE2__)
+	__m128 acc0 = _mm_setzero_ps();
+	__m128 acc1 = _mm_setzero_ps();
+	for (i = 0; i < n; i += 8) {
+		acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+		acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+	}
+	acc0 = _mm_add_ps(acc0, acc1);
+	acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+	acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+	sum = _mm_cvtss_f32(acc0);
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	float32x4_t acc0 = vdupq_n_f32(0);
+	float32x4_t acc1 = vdupq_n_f32(0);
+	float32x2_t h;
+	for (i = 0; i < n; i += 8) {
+		acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+		acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+	}
+	acc0 = vaddq_f32(acc0, acc1);
+	h = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+	sum = vget_lane_f32(vpadd_f32(h, h), 0);
+#else
+	float s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+	for (i = 0; i < n; i += 4) {
+		s0 += a[i] * b[i];
+		s1 += a[i+1] * b[i+1];
+		s2 += a[i+2] * b[i+2];
+		s3 += a[i+3] * b[i+3];
 	}
-	s->result_len = i2;
+	sum = (s0 + s1) + (s2 + s3);
+#endif
+	return sum;
 }
 
-void fifth_order(int16_t *data, int length, int16_t *hist)
-/* for half of interleaved data */
+int resample(struct resampler *r, const int16_t *in, int len,
+	     int16_t *out, int max_out)
+/* out may be in, returns the output length */
 {
-	int i;
-	int16_t a, b, c, d, e, f;
-	a = hist[1];
-	b = hist[2];
-	c = hist[3];
-	d = hist[4];
-	e = hist[5];
-	f = data[0];
-	/* a downsample should improve resolution, so don't fully shift */
-	data[0] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	for (i=4; i<length; i+=4) {
-		a = c;
-		b = d;
-		c = e;
-		d = f;
-		e = data[i-2];
-		f = data[i];
-		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	}
-	/* archive */
-	hist[0] = a;
-	hist[1] = b;
-	hist[2] = c;
-	hist[3] = d;
-	hist[4] = e;
-	hist[5] = f;
-}
-
-void generic_fir(int16_t *data, int length, int *fir, int16_t *hist)
-/* Okay, not at all generic.  Assumes length 9, fix that eventually. */
-{
-	int d, temp, sum;
-	for (d=0; d<length; d+=2) {
-		temp = data[d];
-		sum = 0;
-		sum += (hist[0] + hist[8]) * fir[1];
-		sum += (hist[1] + hist[7]) * fir[2];
-		sum += (hist[2] + hist[6]) * fir[3];
-		sum += (hist[3] + hist[5]) * fir[4];
-		sum +=            hist[4]  * fir[5];
-		data[d] = sum >> 15 ;
-		hist[0] = hist[1];
-		hist[1] = hist[2];
-		hist[2] = hist[3];
-		hist[3] = hist[4];
-		hist[4] = hist[5];
-		hist[5] = hist[6];
-		hist[6] = hist[7];
-		hist[7] = hist[8];
-		hist[8] = temp;
+	int i, n = 0, base;
+	int taps = r->taps;
+	float y;
+	float *x = r->hist;
+	for (i = 0; i < len; i++) {
+		x[taps - 1 + i] = in[i];}
+	while ((base = r->pos / r->up) < len && n < max_out) {
+		y = dot_f32(r->bank + (r->pos % r->up) * taps, x + base, taps);
+		if (y > 32767.0f) {
+			y = 32767.0f;}
+		if (y < -32768.0f) {
+			y = -32768.0f;}
+		out[n++] = (int16_t)lrintf(y);
+		r->pos += r->down;
+	}
+	r->pos -= len * r->up;
+	memmove(x, x + len, (taps - 1) * sizeof(float));
+	return n;
+}
+
+static double bessel_i0(double x)
+{
+	double sum = 1, term = 1;
+	int k;
+	for (k = 1; k < 32; k++) {
+		term *= (x / (2 * k)) * (x / (2 * k));
+		sum += term;
 	}
+	return sum;
+}
+
+static int gcd(int a, int b)
+{
+	int t;
+	while (b) {
+		t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+void resampler_cleanup(struct resampler *r)
+{
+	free(r->bank);
+	free(r->hist);
+	r->bank = NULL;
+	r->hist = NULL;
+}
+
+int resampler_init(struct resampler *r, int rate_in, int rate_out, int max_len)
+/* max_len input samples per call, returns -1 on allocation failure and
+ * -EINVAL if the rates have no small enough common factor */
+{
+	int i, k, n, g = gcd(rate_in, rate_out);
+	double fc, t, w, sum = 0;
+	const double beta = 8.0;  /* about 80 dB stop band */
+	double *h;
+
+	memset(r, 0, sizeof(*r));
+	r->up = rate_out / g;
+	r->down = rate_in / g;
+	if (r->up > RESAMPLE_MAX_PHASES) {
+		return -EINVAL;}
+	r->taps = RESAMPLE_TAPS * ((r->down + r->up - 1) / r->up);
+	n = r->up * r->taps;
+	/* transition band of about 5 input rates / taps, ending at the
+	 * lower nyquist frequency */
+	fc = (0.5 * (rate_in < rate_out ? rate_in : rate_out)
+		- 2.5 * rate_in / r->taps) / ((double)rate_in * r->up);
+
+	h = malloc(n * sizeof(double));
+	r->bank = malloc(n * sizeof(float));
+	r->hist = calloc(r->taps - 1 + max_len, sizeof(float));
+	if (!h || !r->bank || !r->hist) {
+		free(h);
+		resampler_cleanup(r);
+		return -1;
+	}
+	for (i = 0; i < n; i++) {
+		t = i - (n - 1) / 2.0;
+		w = 2 * t / (n - 1);
+		w = bessel_i0(beta * sqrt(1 - w * w)) / bessel_i0(beta);
+		h[i] = w * (t == 0 ? 2 * fc : sin(2 * M_PI * fc * t) / (M_PI * t));
+		sum += h[i];
+	}
+	for (i = 0; i < r->up; i++) {
+		for (k = 0; k < r->taps; k++) {
+			r->bank[i * r->taps + r->taps - 1 - k] =
+				(float)(h[i + k * r->up] * r->up / sum);}
+	}
+	free(h);
+	return 0;
 }
 
 /* define our own complex math ops
@@ -517,6 +1084,170 @@ int polar_disc_lut(int ar, int aj, int br, int bj)
 	return 0;
 }
 
+/*
+ * atan(a) on [0, 1] as a 9th order polynomial, max error 1e-5 rad, which is
+ * 0.05 of the pi / (1<<14) output step.  Only uses operations that all of
+ * the SIMD flavours below have, so they agree with the scalar version.
+ */
+#define ATAN_A1		0.9998660f
+#define ATAN_A3		-0.3302995f
+#define ATAN_A5		0.1801410f
+#define ATAN_A7		-0.0851330f
+#define ATAN_A9		0.0208351f
+#define ATAN_PI		3.14159265f
+#define ATAN_SCALE	((float)(1<<14) / ATAN_PI)
+
+int polar_disc_poly(int cr, int cj)
+{
+	float x = (float)cr, y = (float)cj;
+	float ax = fabsf(x), ay = fabsf(y);
+	float a, s, r;
+	if (ay > ax) {
+		a = ax / (ay + FLT_MIN);
+	} else {
+		a = ay / (ax + FLT_MIN);}
+	s = a * a;
+	r = ((((ATAN_A9 * s + ATAN_A7) * s + ATAN_A5) * s + ATAN_A3) * s + ATAN_A1) * a;
+	if (ay > ax) {
+		r = ATAN_PI / 2 - r;}
+	if (x < 0) {
+		r = ATAN_PI - r;}
+	if (y < 0) {
+		r = -r;}
+	return (int)lrintf(r * ATAN_SCALE);
+}
+
+#if defined(__AVX2__)
+static __m256 atan2_poly_ps(__m256 y, __m256 x)
+{
+	const __m256 abs_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	const __m256 sign_mask = _mm256_castsi256_ps(_mm256_set1_epi32(0x80000000));
+	__m256 ax = _mm256_and_ps(x, abs_mask);
+	__m256 ay = _mm256_and_ps(y, abs_mask);
+	__m256 swap = _mm256_cmp_ps(ay, ax, _CMP_GT_OQ);
+	__m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay),
+		_mm256_add_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(FLT_MIN)));
+	__m256 s = _mm256_mul_ps(a, a);
+	__m256 r = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(ATAN_A9), s), _mm256_set1_ps(ATAN_A7));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_A5));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_A3));
+	r = _mm256_add_ps(_mm256_mul_ps(r, s), _mm256_set1_ps(ATAN_A1));
+	r = _mm256_mul_ps(r, a);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(ATAN_PI / 2), r), swap);
+	r = _mm256_blendv_ps(r, _mm256_sub_ps(_mm256_set1_ps(ATAN_PI), r),
+		_mm256_cmp_ps(x, _mm256_setzero_ps(), _CMP_LT_OQ));
+	return _mm256_xor_ps(r, _mm256_and_ps(y, sign_mask));
+}
+#elif defined(__SSE2__)
+static __m128 atan2_poly_ps(__m128 y, __m128 x)
+{
+	const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	const __m128 sign_mask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 ax = _mm_and_ps(x, abs_mask);
+	__m128 ay = _mm_and_ps(y, abs_mask);
+	__m128 swap = _mm_cmpgt_ps(ay, ax);
+	__m128 xneg = _mm_cmplt_ps(x, _mm_setzero_ps());
+	__m128 a = _mm_div_ps(_mm_min_ps(ax, ay),
+		_mm_add_ps(_mm_max_ps(ax, ay), _mm_set1_ps(FLT_MIN)));
+	__m128 s = _mm_mul_ps(a, a);
+	__m128 r = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(ATAN_A9), s), _mm_set1_ps(ATAN_A7));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_A5));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_A3));
+	r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(ATAN_A1));
+	r = _mm_mul_ps(r, a);
+	r = _mm_or_ps(_mm_and_ps(swap, _mm_sub_ps(_mm_set1_ps(ATAN_PI / 2), r)),
+		_mm_andnot_ps(swap, r));
+	r = _mm_or_ps(_mm_and_ps(xneg, _mm_sub_ps(_mm_set1_ps(ATAN_PI), r)),
+		_mm_andnot_ps(xneg, r));
+	return _mm_xor_ps(r, _mm_and_ps(y, sign_mask));
+}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+static float32x4_t atan2_poly_f32(float32x4_t y, float32x4_t x)
+{
+	float32x4_t ax = vabsq_f32(x);
+	float32x4_t ay = vabsq_f32(y);
+	uint32x4_t swap = vcgtq_f32(ay, ax);
+	float32x4_t d = vaddq_f32(vmaxq_f32(ax, ay), vdupq_n_f32(FLT_MIN));
+	/* no vector divide on armv7, two Newton steps on the estimate */
+	float32x4_t inv = vrecpeq_f32(d);
+	float32x4_t a, s, r;
+	inv = vmulq_f32(vrecpsq_f32(d, inv), inv);
+	inv = vmulq_f32(vrecpsq_f32(d, inv), inv);
+	a = vmulq_f32(vminq_f32(ax, ay), inv);
+	s = vmulq_f32(a, a);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_A7), vdupq_n_f32(ATAN_A9), s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_A5), r, s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_A3), r, s);
+	r = vmlaq_f32(vdupq_n_f32(ATAN_A1), r, s);
+	r = vmulq_f32(r, a);
+	r = vbslq_f32(swap, vsubq_f32(vdupq_n_f32(ATAN_PI / 2), r), r);
+	r = vbslq_f32(vcltq_f32(x, vdupq_n_f32(0)),
+		vsubq_f32(vdupq_n_f32(ATAN_PI), r), r);
+	return vbslq_f32(vcltq_f32(y, vdupq_n_f32(0)), vnegq_f32(r), r);
+}
+#endif
+
+/* polar_disc_poly() of each sample against the one before, for n samples */
+void polar_disc_poly_block(const int16_t *lp, int16_t *out, int n)
+{
+	int k = 0;
+#if defined(__AVX2__)
+	const __m256i neg = _mm256_set1_epi32(0x0001ffff);
+	const __m256 scale = _mm256_set1_ps(ATAN_SCALE);
+	__m256i a, b, cr, cj, pcm;
+	for (; k + 8 <= n; k += 8) {
+		/* a * conj(b) straight from the interleaved samples */
+		a = _mm256_loadu_si256((const __m256i *)(lp + 2*k + 2));
+		b = _mm256_loadu_si256((const __m256i *)(lp + 2*k));
+		cr = _mm256_madd_epi16(a, b);
+		b = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(b, 0xb1), 0xb1);
+		cj = _mm256_madd_epi16(a, _mm256_sign_epi16(b, neg));
+		pcm = _mm256_cvtps_epi32(_mm256_mul_ps(scale, atan2_poly_ps(
+			_mm256_cvtepi32_ps(cj), _mm256_cvtepi32_ps(cr))));
+		pcm = _mm256_permute4x64_epi64(_mm256_packs_epi32(pcm, pcm), 0x08);
+		_mm_storeu_si128((__m128i *)(out + k), _mm256_castsi256_si128(pcm));
+	}
+#elif defined(__SSE2__)
+	const __m128i neg = _mm_set1_epi32(0x0001ffff);
+	const __m128 scale = _mm_set1_ps(ATAN_SCALE);
+	__m128i a, b, cr, cj, pcm;
+	for (; k + 4 <= n; k += 4) {
+		/* a * conj(b) straight from the interleaved samples */
+		a = _mm_loadu_si128((const __m128i *)(lp + 2*k + 2));
+		b = _mm_loadu_si128((const __m128i *)(lp + 2*k));
+		cr = _mm_madd_epi16(a, b);
+		b = _mm_shufflehi_epi16(_mm_shufflelo_epi16(b, 0xb1), 0xb1);
+		cj = _mm_madd_epi16(a, _mm_mullo_epi16(b, neg));
+		pcm = _mm_cvtps_epi32(_mm_mul_ps(scale, atan2_poly_ps(
+			_mm_cvtepi32_ps(cj), _mm_cvtepi32_ps(cr))));
+		_mm_storel_epi64((__m128i *)(out + k), _mm_packs_epi32(pcm, pcm));
+	}
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	const float32x4_t scale = vdupq_n_f32(ATAN_SCALE);
+	const float32x4_t half = vdupq_n_f32(0.5f);
+	int16x4x2_t a, b;
+	int32x4_t cr, cj;
+	float32x4_t r;
+	for (; k + 4 <= n; k += 4) {
+		a = vld2_s16(lp + 2*k + 2);
+		b = vld2_s16(lp + 2*k);
+		cr = vmlal_s16(vmull_s16(a.val[0], b.val[0]), a.val[1], b.val[1]);
+		cj = vmlsl_s16(vmull_s16(a.val[1], b.val[0]), a.val[0], b.val[1]);
+		r = vmulq_f32(scale, atan2_poly_f32(vcvtq_f32_s32(cj),
+			vcvtq_f32_s32(cr)));
+		/* round to nearest, the conversion truncates */
+		r = vaddq_f32(r, vbslq_f32(vcltq_f32(r, vdupq_n_f32(0)),
+			vnegq_f32(half), half));
+		vst1_s16(out + k, vqmovn_s32(vcvtq_s32_f32(r)));
+	}
+#endif
+	for (; k < n; k++) {
+		out[k] = (int16_t)polar_disc_poly(
+			lp[2*k+2] * lp[2*k] + lp[2*k+3] * lp[2*k+1],
+			lp[2*k+3] * lp[2*k] - lp[2*k+2] * lp[2*k+1]);
+	}
+}
+
 void fm_demod(struct demod_state *fm)
 {
 	int i, pcm;
@@ -524,22 +1255,26 @@ void fm_demod(struct demod_state *fm)
 	pcm = polar_discriminant(lp[0], lp[1],
 		fm->pre_r, fm->pre_j);
 	fm->result[0] = (int16_t)pcm;
-	for (i = 2; i < (fm->lp_len-1); i += 2) {
-		switch (fm->custom_atan) {
-		case 0:
-			pcm = polar_discriminant(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 1:
-			pcm = polar_disc_fast(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		case 2:
-			pcm = polar_disc_lut(lp[i], lp[i+1],
-				lp[i-2], lp[i-1]);
-			break;
-		}
-		fm->result[i/2] = (int16_t)pcm;
+	/* the discriminator is picked once per block, not per sample */
+	switch (fm->custom_atan) {
+	case 0:
+		for (i = 2; i < (fm->lp_len-1); i += 2) {
+			fm->result[i/2] = (int16_t)polar_discriminant(
+				lp[i], lp[i+1], lp[i-2], lp[i-1]);}
+		break;
+	case 1:
+		for (i = 2; i < (fm->lp_len-1); i += 2) {
+			fm->result[i/2] = (int16_t)polar_disc_fast(
+				lp[i], lp[i+1], lp[i-2], lp[i-1]);}
+		break;
+	case 2:
+		for (i = 2; i < (fm->lp_len-1); i += 2) {
+			fm->result[i/2] = (int16_t)polar_disc_lut(
+				lp[i], lp[i+1], lp[i-2], lp[i-1]);}
+		break;
+	case 3:
+		polar_disc_poly_block(lp, fm->result + 1, fm->lp_len/2 - 1);
+		break;
 	}
 	fm->pre_r = lp[fm->lp_len - 2];
 	fm->pre_j = lp[fm->lp_len - 1];
@@ -598,8 +1333,8 @@ void raw_demod(struct demod_state *fm)
 
 void deemph_filter(struct demod_state *fm)
 {
-	static int avg;  // cheating...
 	int i, d;
+	int avg = fm->deemph_avg;
 	// de-emph IIR
 	// avg = avg * (1 - alpha) + sample * alpha;
 	for (i = 0; i < fm->result_len; i++) {
@@ -611,6 +1346,7 @@ void deemph_filter(struct demod_state *fm)
 		}
 		fm->result[i] = (int16_t)avg;
 	}
+	fm->deemph_avg = avg;
 }
 
 void dc_block_filter(struct demod_state *fm)
@@ -665,92 +1401,116 @@ int rms(int16_t *samples, int len, int step)
 	return (int)sqrt((p-err) / len);
 }
 
-void arbitrary_upsample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* linear interpolation, len1 < len2 */
-{
-	int i = 1;
-	int j = 0;
-	int tick = 0;
-	double frac;  // use integers...
-	while (j < len2) {
-		frac = (double)tick / (double)len2;
-		buf2[j] = (int16_t)(buf1[i-1]*(1-frac) + buf1[i]*frac);
-		j++;
-		tick += len1;
-		if (tick > len2) {
-			tick -= len2;
-			i++;
-		}
-		if (i >= len1) {
-			i = len1 - 1;
-			tick = len2;
-		}
-	}
+static void stage_add(struct stage_stats *s, const struct stage_stats *a)
+{
+	int b;
+	s->ns += a->ns;
+	if (a->ns_max > s->ns_max) {
+		s->ns_max = a->ns_max;}
+	s->buffers += a->buffers;
+	for (b = 0; b < STAGE_BUCKETS; b++) {
+		s->hist[b] += a->hist[b];}
 }
 
-void arbitrary_downsample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* fractional boxcar lowpass, len1 > len2 */
-{
-	int i = 1;
-	int j = 0;
-	int tick = 0;
-	double remainder = 0;
-	double frac;  // use integers...
-	buf2[0] = 0;
-	while (j < len2) {
-		frac = 1.0;
-		if ((tick + len2) > len1) {
-			frac = (double)(len1 - tick) / (double)len2;}
-		buf2[j] += (int16_t)((double)buf1[i] * frac + remainder);
-		remainder = (double)buf1[i] * (1.0-frac);
-		tick += len2;
-		i++;
-		if (tick > len1) {
-			j++;
-			buf2[j] = 0;
-			tick -= len1;
-		}
-		if (i >= len1) {
-			i = len1 - 1;
-			tick = len1;
-		}
-	}
-	for (j=0; j<len2; j++) {
-		buf2[j] = buf2[j] * len2 / len1;}
+static void stage_count(struct stage_stats *s, uint64_t ns)
+{
+	uint64_t us;
+	int b = 0;
+	s->ns += ns;
+	if (ns > s->ns_max) {
+		s->ns_max = ns;}
+	s->buffers++;
+	for (us = ns / 1000; us && b < STAGE_BUCKETS - 1; us >>= 1) {
+		b++;}
+	s->hist[b]++;
 }
 
-void arbitrary_resample(int16_t *buf1, int16_t *buf2, int len1, int len2)
-/* up to you to calculate lengths and make sure it does not go OOB
- * okay for buffers to overlap, if you are downsampling */
+static const char *stage_names[STAGES] = {"front_end", "cic", "squelch",
+	"demod", "post_lpf", "deemph", "dc_block", "resample"};
+
+void stats_report(struct demod_stats *st, uint64_t now)
+/* everything since the last report, then start over */
 {
-	if (len1 < len2) {
-		arbitrary_upsample(buf1, buf2, len1, len2);
-	} else {
-		arbitrary_downsample(buf1, buf2, len1, len2);
+	int i, b;
+	char hist[STAGE_BUCKETS * 11], *h;
+	char name[16] = "demod";
+	struct stage_stats *s;
+	double secs = (double)(now - st->last_ns) / 1e9;
+	if (st->freq) {
+		sprintf(name, "%u", st->freq);}
+	pthread_mutex_lock(&stats_out.m);
+	if (!st->freq && !channelizer.workers) {
+		/* the single demod reports for the front end too */
+		stage_add(&st->stage[STAGE_FRONT_END], &stats_out.front);
+		memset(&stats_out.front, 0, sizeof(stats_out.front));
+	}
+	for (i = 0; i < STAGES; i++) {
+		s = &st->stage[i];
+		if (!s->buffers) {
+			continue;}
+		h = hist;
+		for (b = 0; b < STAGE_BUCKETS; b++) {
+			h += sprintf(h, b ? ",%u" : "%u", s->hist[b]);}
+		fprintf(stats_out.file, "stats %s %s secs=%.3f buffers=%u "
+			"ns_per_sample=%.3f cpu=%.4f max_us=%.1f hist_log2_us=%s\n",
+			name, stage_names[i], secs, s->buffers,
+			st->samples ? (double)s->ns / (double)st->samples : 0.0,
+			secs > 0 ? (double)s->ns / 1e9 / secs : 0.0,
+			(double)s->ns_max / 1e3, hist);
 	}
+	fflush(stats_out.file);
+	pthread_mutex_unlock(&stats_out.m);
+	memset(st->stage, 0, sizeof(st->stage));
+	st->samples = 0;
+	st->last_ns = now;
+}
+
+static uint64_t stats_begin(struct demod_stats *st, int samples)
+/* start timing a buffer, 0 while -Z is off */
+{
+	uint64_t now;
+	if (!stats_out.file) {
+		return 0;}
+	now = time_ns();
+	if (!st->last_ns) {
+		st->last_ns = now;}
+	if (now - st->last_ns >= (uint64_t)STATS_PERIOD * 1000000000) {
+		stats_report(st, now);}
+	st->samples += samples;
+	return now;
+}
+
+static uint64_t stage_time(struct demod_stats *st, int stage, uint64_t t)
+/* charge the time since t to a stage, returns the new t */
+{
+	uint64_t now;
+	if (!stats_out.file) {
+		return 0;}
+	now = time_ns();
+	stage_count(&st->stage[stage], now - t);
+	return now;
+}
+
+static void front_end_time(struct dongle_state *s, uint64_t t)
+/* the usb callback never waits for a report, it hands over when it can */
+{
+	stage_count(&s->front, time_ns() - t);
+	if (pthread_mutex_trylock(&stats_out.m)) {
+		return;}
+	stage_add(&stats_out.front, &s->front);
+	pthread_mutex_unlock(&stats_out.m);
+	memset(&s->front, 0, sizeof(s->front));
 }
 
 void full_demod(struct demod_state *d)
 {
-	int i, ds_p;
+	int i;
 	int sr = 0;
-	ds_p = d->downsample_passes;
-	if (ds_p) {
-		for (i=0; i < ds_p; i++) {
-			fifth_order(d->lowpassed,   (d->lp_len >> i), d->lp_i_hist[i]);
-			fifth_order(d->lowpassed+1, (d->lp_len >> i) - 1, d->lp_q_hist[i]);
-		}
-		d->lp_len = d->lp_len >> ds_p;
-		/* droop compensation */
-		if (d->comp_fir_size == 9 && ds_p <= CIC_TABLE_MAX) {
-			generic_fir(d->lowpassed, d->lp_len,
-				cic_9_tables[ds_p], d->droop_i_hist);
-			generic_fir(d->lowpassed+1, d->lp_len-1,
-				cic_9_tables[ds_p], d->droop_q_hist);
-		}
-	} else {
-		low_pass(d);
-	}
+	uint64_t t = stats_begin(&d->stats, d->lp_len / 2);
+	if (d->downsample_passes) {
+		d->lp_len = dsp_cic_decimate(&d->cic, d->lowpassed, d->lp_len);
+		t = stage_time(&d->stats, STAGE_CIC, t);}
+	/* without -F the front end has already run low_pass() */
 	/* power squelch */
 	if (d->squelch_level) {
 		sr = rms(d->lowpassed, d->lp_len, 1);
@@ -761,84 +1521,301 @@ void full_demod(struct demod_state *d)
 			}
 		} else {
 			d->squelch_hits = 0;}
+		t = stage_time(&d->stats, STAGE_SQUELCH, t);
 	}
 	d->mode_demod(d);  /* lowpassed -> result */
+	t = stage_time(&d->stats, STAGE_DEMOD, t);
 	if (d->mode_demod == &raw_demod) {
 		return;
 	}
 	/* todo, fm noise squelch */
 	// use nicer filter here too?
 	if (d->post_downsample > 1) {
-		d->result_len = low_pass_simple(d->result, d->result_len, d->post_downsample);}
+		d->result_len = low_pass_simple(d->result, d->result_len, d->post_downsample);
+		t = stage_time(&d->stats, STAGE_POST_LPF, t);}
 	if (d->deemph) {
-		deemph_filter(d);}
+		deemph_filter(d);
+		t = stage_time(&d->stats, STAGE_DEEMPH, t);}
 	if (d->dc_block) {
-		dc_block_filter(d);}
-	if (d->rate_out2 > 0) {
-		low_pass_real(d);
-		//arbitrary_resample(d->result, d->result, d->result_len, d->result_len * d->rate_out2 / d->rate_out);
-	}
+		dc_block_filter(d);
+		t = stage_time(&d->stats, STAGE_DC_BLOCK, t);}
+	if (d->resamp.bank) {
+		d->result_len = resample(&d->resamp, d->result, d->result_len,
+			d->result, d->result_size);
+		stage_time(&d->stats, STAGE_RESAMPLE, t);}
 }
 
-static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
+int fft_init(struct fft_state *f, int n)
+/* n a power of two */
 {
-	int i;
-	struct dongle_state *s = ctx;
-	struct demod_state *d = s->demod_target;
-
-	if (do_exit) {
-		return;}
-	if (!ctx) {
-		return;}
-	if (s->mute) {
-		for (i=0; i<s->mute; i++) {
-			buf[i] = 127;}
-		s->mute = 0;
+	int i, k;
+	f->n = n;
+	f->buf = malloc(2 * n * sizeof(float));
+	f->twiddle = malloc(n * sizeof(float));
+	f->rev = malloc(n * sizeof(int));
+	if (!f->buf || !f->twiddle || !f->rev) {
+		return -1;}
+	for (i = 0; i < n / 2; i++) {
+		f->twiddle[2*i]   = (float)cos(2 * M_PI * i / n);
+		f->twiddle[2*i+1] = (float)sin(2 * M_PI * i / n);
 	}
-	if (!s->offset_tuning) {
-		rotate_90(buf, len);}
-	for (i=0; i<(int)len; i++) {
-		s->buf16[i] = (int16_t)buf[i] - 127;}
-	pthread_rwlock_wrlock(&d->rw);
-	memcpy(d->lowpassed, s->buf16, 2*len);
-	d->lp_len = len;
-	pthread_rwlock_unlock(&d->rw);
-	safe_cond_signal(&d->ready, &d->ready_m);
+	for (i = 0; i < n; i++) {
+		f->rev[i] = 0;
+		for (k = 1; k < n; k <<= 1) {
+			f->rev[i] = (f->rev[i] << 1) | ((i / k) & 1);}
+	}
+	return 0;
 }
 
-static void *dongle_thread_fn(void *arg)
+void fft_cleanup(struct fft_state *f)
 {
-	struct dongle_state *s = arg;
-	int r = rtlsdr_read_async(s->dev, rtlsdr_callback, s, 0, s->buf_len);
-	if (r != 0 && !do_exit) {
-		fprintf(stderr, "\nDevice error detected, async read returned: %d\n", r);
-		do_exit = 1;
-	}
-	return 0;
+	free(f->buf);
+	free(f->twiddle);
+	free(f->rev);
 }
 
-static void *demod_thread_fn(void *arg)
+void fft_inverse(struct fft_state *f)
+/* in place radix 2 inverse dft, unscaled, bin k is -k * rate / n Hz */
 {
-	struct demod_state *d = arg;
-	struct output_state *o = d->output_target;
-	while (!do_exit) {
-		safe_cond_wait(&d->ready, &d->ready_m);
-		pthread_rwlock_wrlock(&d->rw);
-		full_demod(d);
-		pthread_rwlock_unlock(&d->rw);
+	int i, j, k, len, half, step;
+	int n = f->n;
+	float *a = f->buf;
+	float tr, tj, wr, wj;
+	for (i = 0; i < n; i++) {
+		j = f->rev[i];
+		if (j <= i) {
+			continue;}
+		tr = a[2*i]; a[2*i] = a[2*j]; a[2*j] = tr;
+		tj = a[2*i+1]; a[2*i+1] = a[2*j+1]; a[2*j+1] = tj;
+	}
+	for (len = 2; len <= n; len <<= 1) {
+		half = len / 2;
+		step = n / len;
+		for (i = 0; i < n; i += len) {
+			for (k = 0; k < half; k++) {
+				wr = f->twiddle[2*k*step];
+				wj = f->twiddle[2*k*step+1];
+				j = i + k + half;
+				tr = a[2*j] * wr - a[2*j+1] * wj;
+				tj = a[2*j] * wj + a[2*j+1] * wr;
+				a[2*j]   = a[2*(i+k)] - tr;
+				a[2*j+1] = a[2*(i+k)+1] - tj;
+				a[2*(i+k)]   += tr;
+				a[2*(i+k)+1] += tj;
+			}
+		}
+	}
+}
+
+static int scan_level(struct demod_state *d, int i)
+/* squelch level of channel i, as rms() would measure it after low_pass() */
+{
+	struct controller_state *cs = &controller;
+	int k, lo, hi, n = scan.fft.n;
+	double off = (double)cs->freqs[i] - cs->win_tune[cs->win_of[i]];
+	double bin_hz = (double)dongle.rate / n;
+	double p = 0;
+	if (!scan.frames) {
+		return 0;}
+	lo = (int)ceil((off - d->rate_in / 2) / bin_hz);
+	hi = (int)floor((off + d->rate_in / 2) / bin_hz);
+	for (k = lo; k <= hi; k++) {
+		p += scan.power[((-k % n) + n) % n];}
+	/* parseval, then the gain of the low_pass() boxcar */
+	p /= scan.frames * n * scan.hann_sq;
+	return (int)(d->downsample * sqrt(p / 2));
+}
+
+static void scan_power(const unsigned char *buf, int len)
+/* averaged power spectrum of the end of the buffer, the start may be muted */
+{
+	int f, i, n = scan.fft.n;
+	const unsigned char *p;
+	scan.frames = len / (2 * n);
+	if (scan.frames > SCAN_FRAMES) {
+		scan.frames = SCAN_FRAMES;}
+	p = buf + len - scan.frames * 2 * n;
+	memset(scan.power, 0, n * sizeof(float));
+	for (f = 0; f < scan.frames; f++, p += 2 * n) {
+		for (i = 0; i < n; i++) {
+			scan.fft.buf[2*i]   = scan.hann[i] * ((int)p[2*i] - 127);
+			scan.fft.buf[2*i+1] = scan.hann[i] * ((int)p[2*i+1] - 127);
+		}
+		fft_inverse(&scan.fft);
+		for (i = 0; i < n; i++) {
+			scan.power[i] += scan.fft.buf[2*i] * scan.fft.buf[2*i]
+				+ scan.fft.buf[2*i+1] * scan.fft.buf[2*i+1];
+		}
+	}
+}
+
+static void scan_select(struct demod_state *d, int i)
+/* demodulate channel i of the current window, without retuning */
+{
+	struct controller_state *cs = &controller;
+	double f = -((double)cs->freqs[i] - cs->win_tune[cs->win_of[i]])
+		- cs->edge * d->rate_in / 2;
+	d->nco_step_r = (float)cos(2 * M_PI * f / dongle.rate);
+	d->nco_step_j = (float)sin(2 * M_PI * f / dongle.rate);
+	d->nco_r = 1.0f;
+	d->nco_j = 0.0f;
+	d->nco_on = 1;
+	cs->freq_now = i;
+	scan.select_at = d->queue.queued;
+}
+
+static void scan_check(struct demod_state *d, const unsigned char *buf, int len)
+/* while squelched, lock to the next active channel of the window or hop */
+{
+	struct controller_state *cs = &controller;
+	int i, k, w = cs->win_now;
+	if (scan.win_applied != w) {
+		/* first buffer after a retune, may still hold the old window */
+		scan.win_applied = w;
+		scan.hop_pending = 0;
+		for (i = 0; cs->win_of[i] != w; i++) {}
+		scan_select(d, i);
+		return;
+	}
+	/* squelch_hits belongs to the demod thread and only says something
+	 * about this channel once its first buffer has been demodulated */
+	if (scan.hop_pending || (int32_t)(d->demodded - scan.select_at) <= 0 ||
+	    d->squelch_hits <= d->conseq_squelch) {
+		return;}
+	scan_power(buf, len);
+	/* the current channel reopens by itself, check the others */
+	for (k = 1; k < cs->freq_len; k++) {
+		i = (cs->freq_now + k) % cs->freq_len;
+		if (cs->win_of[i] != w) {
+			continue;}
+		if (scan_level(d, i) >= d->squelch_level) {
+			scan_select(d, i);
+			return;
+		}
+	}
+	if (cs->win_len > 1) {
+		scan.hop_pending = 1;
+		pthread_mutex_lock(&cs->hop_m);
+		cs->hop_req = 1;
+		pthread_cond_signal(&cs->hop);
+		pthread_mutex_unlock(&cs->hop_m);
+	}
+}
+
+static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
+{
+	int i, n;
+	uint64_t t = 0;
+	struct dongle_state *s = ctx;
+	struct demod_state *d = s->demod_target;
+	int16_t *lp;
+
+	if (do_exit) {
+		return;}
+	if (!ctx) {
+		return;}
+	if (s->mute) {
+		for (i=0; i<s->mute; i++) {
+			buf[i] = 127;}
+		s->mute = 0;
+	}
+	/* the demod is QUEUE_DEPTH buffers behind, drop this one */
+	lp = queue_free_buf(&d->queue);
+	if (!lp) {
+		return;}
+	if (channelizer.workers) {
+		/* the filter bank takes the whole capture as is */
+		widen_rotate(buf, (int)len, 0, lp);
+		queue_push(&d->queue, (int)len);
+		return;
+	}
+	if (controller.win_len) {
+		scan_check(d, buf, (int)len);}
+	if (input.file || stats_out.file) {
+		t = time_ns();}
+	n = front_end(d, buf, (int)len, !s->offset_tuning && !d->nco_on, lp);
+	if (input.file) {
+		input.front_ns += time_ns() - t;}
+	if (stats_out.file) {
+		front_end_time(s, t);}
+	queue_push(&d->queue, n);
+}
+
+static void input_read(struct dongle_state *s)
+/* the recording goes through the usb callback, as fast as the demod takes it */
+{
+	unsigned char *buf = malloc(s->buf_len);
+	size_t n;
+	if (!buf) {
+		fprintf(stderr, "Failed to allocate input buffer.\n");
+		do_exit = 1;
+		return;
+	}
+	input.start_ns = time_ns();
+	while (!do_exit) {
+		n = fread(buf, 1, s->buf_len, input.file);
+		/* whole blocks for the cic, a tail is dropped */
+		n -= n % (2 << demod.downsample_passes);
+		if (!n) {
+			break;}
+		input.samples += n / 2;
+		rtlsdr_callback(buf, (uint32_t)n, s);
+	}
+	queue_end(&s->demod_target->queue);
+	free(buf);
+}
+
+static void *dongle_thread_fn(void *arg)
+{
+	struct dongle_state *s = arg;
+	int r;
+	if (input.file) {
+		input_read(s);
+		return 0;
+	}
+	r = rtlsdr_read_async(s->dev, rtlsdr_callback, s, 0, s->buf_len);
+	if (r != 0 && !do_exit) {
+		fprintf(stderr, "\nDevice error detected, async read returned: %d\n", r);
+		do_exit = 1;
+	}
+	return 0;
+}
+
+static void *demod_thread_fn(void *arg)
+{
+	struct demod_state *d = arg;
+	struct output_state *o = d->output_target;
+	uint64_t t = 0;
+	while (!do_exit) {
+		d->lowpassed = queue_wait(&d->queue, &d->lp_len);
+		if (!d->lowpassed) {
+			break;}
+		if (d->lp_len == END_OF_STREAM) {
+			queue_release(&d->queue);
+			queue_end(&o->queue);
+			break;
+		}
+		/* demodulate straight into the output queue, if there is room */
+		d->result = queue_free_buf(&o->queue);
+		if (!d->result) {
+			d->result = d->result_drop;}
+		if (input.file) {
+			t = time_ns();}
+		full_demod(d);
+		if (input.file) {
+			input.demod_ns += time_ns() - t;}
+		d->demodded++;
+		queue_release(&d->queue);
 		if (d->exit_flag) {
 			do_exit = 1;
 		}
 		if (d->squelch_level && d->squelch_hits > d->conseq_squelch) {
 			d->squelch_hits = d->conseq_squelch + 1;  /* hair trigger */
-			safe_cond_signal(&controller.hop, &controller.hop_m);
+			/* scan_check() picks the next channel */
 			continue;
 		}
-		pthread_rwlock_wrlock(&o->rw);
-		memcpy(o->result, d->result, 2*d->result_len);
-		o->result_len = d->result_len;
-		pthread_rwlock_unlock(&o->rw);
-		safe_cond_signal(&o->ready, &o->ready_m);
+		if (d->result != d->result_drop) {
+			queue_push(&o->queue, d->result_len);}
 	}
 	return 0;
 }
@@ -846,16 +1823,331 @@ static void *demod_thread_fn(void *arg)
 static void *output_thread_fn(void *arg)
 {
 	struct output_state *s = arg;
+	int16_t *buf;
+	int len;
+	uint64_t t = 0;
 	while (!do_exit) {
 		// use timedwait and pad out under runs
-		safe_cond_wait(&s->ready, &s->ready_m);
-		pthread_rwlock_rdlock(&s->rw);
-		fwrite(s->result, 2, s->result_len, s->file);
-		pthread_rwlock_unlock(&s->rw);
+		buf = queue_wait(&s->queue, &len);
+		if (!buf) {
+			break;}
+		if (len == END_OF_STREAM) {
+			queue_release(&s->queue);
+			input.end_ns = time_ns();
+			do_exit = 1;
+			break;
+		}
+		if (input.file) {
+			t = time_ns();}
+		fwrite(buf, 2, len, s->file);
+		if (input.file) {
+			input.output_ns += time_ns() - t;}
+		queue_release(&s->queue);
 	}
 	return 0;
 }
 
+static void chan_fold(struct channelizer_state *c)
+/* fold the windowed taps into the fft input, newest sample at next_t */
+{
+	int m, l;
+	float sr, sj;
+	const float *x = c->x + 2 * c->next_t;
+	for (m = 0; m < c->bins; m++) {
+		sr = sj = 0;
+		for (l = m; l < c->taps; l += c->bins) {
+			sr += c->proto[l] * x[-2*l];
+			sj += c->proto[l] * x[-2*l + 1];
+		}
+		c->fft.buf[2*m]   = sr;
+		c->fft.buf[2*m+1] = sj;
+	}
+}
+
+static int16_t chan_clamp(float v)
+{
+	if (v > 32767.0f) {
+		return 32767;}
+	if (v < -32767.0f) {
+		return -32767;}
+	return (int16_t)lrintf(v);
+}
+
+static void chan_input(struct channelizer_state *c, const int16_t *in, int len,
+		       int dc_r, int dc_j)
+/* one chunk of the capture in, one worker buffer per worker out */
+{
+	int16_t *out[CHANNELS_LIMIT];
+	int i, b, k, w, blocks, keep;
+	int d = c->bins / 2;
+	float yr, yj, t, mag;
+	struct channel *ch;
+
+	for (i = 0; i < len; i += 2) {
+		c->x[2*c->x_len + i]     = (float)(in[i] - dc_r);
+		c->x[2*c->x_len + i + 1] = (float)(in[i+1] - dc_j);
+	}
+	c->x_len += len / 2;
+	blocks = 0;
+	if (c->next_t < c->x_len) {
+		blocks = (c->x_len - c->next_t + d - 1) / d;}
+	for (w = 0; w < c->workers; w++) {
+		out[w] = blocks ? queue_free_buf(&c->worker[w].queue) : NULL;}
+
+	for (b = 0; b < blocks; b++) {
+		chan_fold(c);
+		fft_inverse(&c->fft);
+		for (w = 0; w < c->workers; w++) {
+			for (k = 0; k < c->worker[w].count; k++) {
+				ch = &c->chan[c->worker[w].first + k];
+				yr = c->fft.buf[2*ch->bin];
+				yj = c->fft.buf[2*ch->bin+1];
+				/* e^-j*pi*bin*block, blocks are half the fft size */
+				if (ch->bin & c->block & 1) {
+					yr = -yr;
+					yj = -yj;
+				}
+				if (out[w]) {
+					out[w][2*(k*blocks + b)] =
+						chan_clamp((yr * ch->nco_r - yj * ch->nco_j) * c->scale);
+					out[w][2*(k*blocks + b) + 1] =
+						chan_clamp((yr * ch->nco_j + yj * ch->nco_r) * c->scale);
+				}
+				t = ch->nco_r * ch->step_r - ch->nco_j * ch->step_j;
+				ch->nco_j = ch->nco_r * ch->step_j + ch->nco_j * ch->step_r;
+				ch->nco_r = t;
+			}
+		}
+		c->next_t += d;
+		c->block++;
+	}
+
+	for (i = 0; i < c->count; i++) {
+		ch = &c->chan[i];
+		mag = 1.0f / sqrtf(ch->nco_r * ch->nco_r + ch->nco_j * ch->nco_j);
+		ch->nco_r *= mag;
+		ch->nco_j *= mag;
+	}
+	for (w = 0; w < c->workers; w++) {
+		if (out[w]) {
+			queue_push(&c->worker[w].queue, 2 * blocks * c->worker[w].count);}
+	}
+	/* keep the history the next block needs */
+	keep = c->x_len - (c->next_t - (c->taps - 1));
+	memmove(c->x, c->x + 2 * (c->x_len - keep), 2 * keep * sizeof(float));
+	c->next_t -= c->x_len - keep;
+	c->x_len = keep;
+}
+
+static void *chan_thread_fn(void *arg)
+{
+	struct channelizer_state *c = arg;
+	int16_t *buf;
+	int i, n, len;
+	long sum_r, sum_j;
+	while (!do_exit) {
+		buf = queue_wait(&demod.queue, &len);
+		if (!buf) {
+			break;}
+		/* the dongle's dc spike, otherwise the bin at the centre suffers */
+		sum_r = sum_j = 0;
+		for (i = 0; i < len; i += 2) {
+			sum_r += buf[i];
+			sum_j += buf[i+1];
+		}
+		for (i = 0; i < len; i += n) {
+			n = len - i;
+			if (n > 2 * CHAN_CHUNK) {
+				n = 2 * CHAN_CHUNK;}
+			chan_input(c, buf + i, n, (int)(2 * sum_r / len), (int)(2 * sum_j / len));
+		}
+		queue_release(&demod.queue);
+	}
+	return 0;
+}
+
+static void *chan_worker_fn(void *arg)
+{
+	struct chan_worker *w = arg;
+	struct channel *ch;
+	struct demod_state *d;
+	int16_t *buf;
+	int k, len, seg;
+	while (!do_exit) {
+		buf = queue_wait(&w->queue, &len);
+		if (!buf) {
+			break;}
+		seg = len / w->count;
+		for (k = 0; k < w->count; k++) {
+			ch = &channelizer.chan[w->first + k];
+			d = &ch->demod;
+			d->lowpassed = buf + k * seg;
+			d->lp_len = low_pass(d, d->lowpassed, seg, d->lowpassed);
+			d->result = d->result_drop;
+			full_demod(d);
+			/* per channel squelch, nothing is written while closed */
+			if (d->squelch_level && d->squelch_hits > d->conseq_squelch) {
+				d->squelch_hits = d->conseq_squelch + 1;
+				continue;
+			}
+			fwrite(d->result, 2, d->result_len, ch->file);
+		}
+		queue_release(&w->queue);
+	}
+	return 0;
+}
+
+static int chan_valid_rate(uint32_t rate)
+{
+	return (rate > 225000 && rate <= 300000) ||
+	       (rate > 900000 && rate <= MAXIMUM_CAPTURE_RATE);
+}
+
+void chan_init(struct channelizer_state *c, char *filename)
+{
+	uint32_t lo, hi, need, rate = 0;
+	int i, k, w, bins = 0, ds;
+	double bin_hz, chan_rate, off, res, x, win, sum;
+	struct channel *ch;
+
+	c->count = controller.freq_len;
+	if (c->count > CHANNELS_LIMIT) {
+		fprintf(stderr, "Too many channels, maximum %i.\n", CHANNELS_LIMIT);
+		exit(1);
+	}
+	if (strcmp(filename, "-") == 0) {
+		fprintf(stderr, "Please specify an output filename, one file per channel.\n");
+		exit(1);
+	}
+	lo = hi = controller.freqs[0];
+	for (i = 1; i < c->count; i++) {
+		if (controller.freqs[i] < lo) {
+			lo = controller.freqs[i];}
+		if (controller.freqs[i] > hi) {
+			hi = controller.freqs[i];}
+	}
+	/* keep every channel inside the middle 90% of the capture */
+	need = (uint32_t)(((hi - lo) / 2 + demod.rate_in / 2) / 0.45);
+
+	/* narrowest bins first, the filter bank does the channel selection */
+	for (ds = CHAN_MIN_DOWNSAMPLE; ds <= CHAN_MAX_DOWNSAMPLE && !rate; ds++) {
+		for (bins = 4; bins <= 4096; bins <<= 1) {
+			rate = (uint32_t)(bins / 2 * demod.rate_in * ds);
+			if (rate >= need && chan_valid_rate(rate)) {
+				break;}
+			rate = 0;
+		}
+	}
+	if (!rate) {
+		fprintf(stderr, "Channels span too much, maximum %i Hz.\n",
+			(int)(0.9 * MAXIMUM_CAPTURE_RATE) - demod.rate_in);
+		exit(1);
+	}
+	ds--;
+	demod.downsample = bins / 2 * ds;
+	c->bins = bins;
+	c->taps = bins * CHAN_TAPS;
+	c->downsample = ds;
+	/* a full scale tone still fits in int16 after low_pass() */
+	c->scale = (float)(1<<15) / (128 * ds);
+	dongle.rate = rate;
+	dongle.freq = lo + (hi - lo) / 2;
+	bin_hz = (double)rate / bins;
+	chan_rate = 2 * bin_hz;
+
+	c->proto = malloc(c->taps * sizeof(float));
+	c->x = calloc(2 * (c->taps - 1 + CHAN_CHUNK), sizeof(float));
+	c->chan = calloc(c->count, sizeof(struct channel));
+	if (c->workers > c->count) {
+		c->workers = c->count;}
+	c->worker = calloc(c->workers, sizeof(struct chan_worker));
+	if (!c->proto || !c->x || !c->chan || !c->worker ||
+	    fft_init(&c->fft, bins) < 0) {
+		fprintf(stderr, "Failed to allocate channelizer buffers.\n");
+		exit(1);
+	}
+
+	/* blackman windowed sinc, cut off at one bin from the centre */
+	sum = 0;
+	for (i = 0; i < c->taps; i++) {
+		x = i - (c->taps - 1) / 2.0;
+		win = 0.42 - 0.5 * cos(2 * M_PI * i / (c->taps - 1))
+			+ 0.08 * cos(4 * M_PI * i / (c->taps - 1));
+		c->proto[i] = (float)(win * (x == 0 ? 1.0 : sin(2 * M_PI * x / bins) / (2 * M_PI * x / bins)));
+		sum += c->proto[i];
+	}
+	for (i = 0; i < c->taps; i++) {
+		c->proto[i] = (float)(c->proto[i] / sum);}
+	c->x_len = c->next_t = c->taps - 1;
+
+	for (i = 0; i < c->count; i++) {
+		ch = &c->chan[i];
+		ch->freq = controller.freqs[i];
+		off = (double)ch->freq - dongle.freq;
+		k = (int)lround(off / bin_hz);
+		res = off - k * bin_hz;
+		ch->bin = (k + bins) % bins;
+		ch->nco_r = 1.0f;
+		ch->nco_j = 0.0f;
+		ch->step_r = (float)cos(-2 * M_PI * res / chan_rate);
+		ch->step_j = (float)sin(-2 * M_PI * res / chan_rate);
+		ch->demod = demod;
+		memset(&ch->demod.queue, 0, sizeof(ch->demod.queue));
+		ch->demod.downsample = ds;
+		/* the filter bank has decimated already, -F does not apply */
+		ch->demod.downsample_passes = 0;
+		ch->demod.output_scale = 1;
+		ch->demod.stats.freq = ch->freq;
+		ch->filename = malloc(strlen(filename) + 12);
+		if (!ch->filename) {
+			fprintf(stderr, "Failed to allocate channelizer buffers.\n");
+			exit(1);
+		}
+		sprintf(ch->filename, "%s.%u", filename, ch->freq);
+		ch->file = fopen(ch->filename, "wb");
+		if (!ch->file) {
+			fprintf(stderr, "Failed to open %s\n", ch->filename);
+			exit(1);
+		}
+	}
+
+	/* one CHAN_CHUNK of every channel, buffers_init() sizes the queues */
+	c->seg_len = 2 * (CHAN_CHUNK / (bins / 2) + 1);
+	for (w = 0; w < c->workers; w++) {
+		c->worker[w].first = c->count * w / c->workers;
+		c->worker[w].count = c->count * (w + 1) / c->workers - c->worker[w].first;
+		queue_init(&c->worker[w].queue);
+	}
+	fprintf(stderr, "Channelizer: %i channels, %i bins of %.0f Hz, %i workers.\n",
+		c->count, bins, bin_hz, c->workers);
+}
+
+void chan_cleanup(struct channelizer_state *c)
+{
+	int i;
+	for (i = 0; i < c->workers; i++) {
+		queue_cleanup(&c->worker[i].queue);}
+	for (i = 0; i < c->count; i++) {
+		resampler_cleanup(&c->chan[i].demod.resamp);
+		fclose(c->chan[i].file);
+		free(c->chan[i].filename);
+	}
+	free(c->worker);
+	free(c->chan);
+	fft_cleanup(&c->fft);
+	free(c->x);
+	free(c->proto);
+}
+
+static uint32_t chan_dropped(struct channelizer_state *c)
+{
+	uint32_t n = 0;
+	int i;
+	for (i = 0; i < c->workers; i++) {
+		n += c->worker[i].queue.dropped;}
+	return n;
+}
+
 static void optimal_settings(int freq, int rate)
 {
 	// giant ball of hacks
@@ -865,9 +2157,15 @@ static void optimal_settings(int freq, int rate)
 	struct demod_state *dm = &demod;
 	struct controller_state *cs = &controller;
 	dm->downsample = (1000000 / dm->rate_in) + 1;
+	if (input.rate) {
+		/* sanity_checks() made it a multiple, a power of two for -F */
+		dm->downsample = (int)(input.rate / dm->rate_in);}
 	if (dm->downsample_passes) {
-		dm->downsample_passes = (int)log2(dm->downsample) + 1;
+		dm->downsample_passes = (int)log2(dm->downsample) + !input.rate;
+		if (dm->downsample_passes > DSP_CIC_MAX_PASSES) {
+			dm->downsample_passes = DSP_CIC_MAX_PASSES;}
 		dm->downsample = 1 << dm->downsample_passes;
+		dsp_cic_init(&dm->cic, dm->downsample_passes, dm->comp_fir_size == 9);
 	}
 	capture_freq = freq;
 	capture_rate = dm->downsample * dm->rate_in;
@@ -883,43 +2181,98 @@ static void optimal_settings(int freq, int rate)
 	d->rate = (uint32_t)capture_rate;
 }
 
+void scan_init(struct controller_state *s)
+/* group the scan list into windows, channels in one window are checked
+ * with a single fft instead of retuning for each of them */
+{
+	struct demod_state *dm = &demod;
+	uint32_t lo, hi, f;
+	int i, j, n, windows = 0;
+	/* rotate_90() keeps dc out of the lower half of the capture */
+	double span = (dongle.offset_tuning ? 0.9 : 0.4) * dongle.rate - dm->rate_in;
+
+	for (i = 0; i < s->freq_len; i++) {
+		s->win_of[i] = -1;}
+	for (i = 0; i < s->freq_len; i++) {
+		if (s->win_of[i] >= 0) {
+			continue;}
+		lo = hi = s->freqs[i];
+		s->win_of[i] = windows;
+		for (j = i + 1; j < s->freq_len; j++) {
+			f = s->freqs[j];
+			if (s->win_of[j] >= 0 ||
+			    (f > hi ? f - lo : hi - (f < lo ? f : lo)) > span) {
+				continue;}
+			s->win_of[j] = windows;
+			if (f < lo) {
+				lo = f;}
+			if (f > hi) {
+				hi = f;}
+		}
+		s->win_tune[windows] = lo + (hi - lo) / 2;
+		if (!dongle.offset_tuning) {
+			s->win_tune[windows] += dongle.rate / 4;}
+		windows++;
+	}
+
+	/* bins of at most a quarter channel */
+	for (n = 64; n < 4 * dm->downsample; n <<= 1) {}
+	scan.hann = malloc(n * sizeof(float));
+	scan.power = malloc(n * sizeof(float));
+	if (!scan.hann || !scan.power || fft_init(&scan.fft, n) < 0) {
+		fprintf(stderr, "Failed to allocate scan buffers.\n");
+		exit(1);
+	}
+	scan.hann_sq = 0;
+	for (i = 0; i < n; i++) {
+		scan.hann[i] = (float)(0.5 - 0.5 * cos(2 * M_PI * i / n));
+		scan.hann_sq += scan.hann[i] * scan.hann[i];
+	}
+	scan.win_applied = -1;
+	s->win_now = 0;
+	dongle.freq = s->win_tune[0];
+	s->win_len = windows;
+	fprintf(stderr, "Scanning %i channels in %i windows.\n", s->freq_len, windows);
+}
+
 static void *controller_thread_fn(void *arg)
 {
 	// thoughts for multiple dongles
 	// might be no good using a controller thread if retune/rate blocks
-	int i;
 	struct controller_state *s = arg;
 
-	if (s->wb_mode) {
-		for (i=0; i < s->freq_len; i++) {
-			s->freqs[i] += 16000;}
-	}
-
-	/* set up primary channel */
-	optimal_settings(s->freqs[0], demod.rate_in);
-	if (dongle.direct_sampling) {
+	/* main() has set up the primary channel, the buffers depend on it */
+	if (!channelizer.workers && s->freq_len > 1) {
+		scan_init(s);}
+	if (dongle.dev && dongle.direct_sampling) {
 		verbose_direct_sampling(dongle.dev, dongle.direct_sampling);}
-	if (dongle.offset_tuning) {
+	if (dongle.dev && dongle.offset_tuning) {
 		verbose_offset_tuning(dongle.dev);}
 
-	/* Set the frequency */
-	verbose_set_frequency(dongle.dev, dongle.freq);
 	fprintf(stderr, "Oversampling input by: %ix.\n", demod.downsample);
 	fprintf(stderr, "Oversampling output by: %ix.\n", demod.post_downsample);
 	fprintf(stderr, "Buffer size: %0.2fms\n",
-		1000 * 0.5 * (float)ACTUAL_BUF_LENGTH / (float)dongle.rate);
+		1000 * 0.5 * (float)dongle.buf_len / (float)dongle.rate);
 
-	/* Set the sample rate */
-	verbose_set_sample_rate(dongle.dev, dongle.rate);
+	/* Set the sample rate and the frequency, tuning only once */
+	if (dongle.dev) {
+		verbose_set_sample_rate_and_frequency(dongle.dev, dongle.rate, dongle.freq);
+	} else {
+		fprintf(stderr, "Reading %s at %u S/s.\n", input.filename, dongle.rate);}
 	fprintf(stderr, "Output at %u Hz.\n", demod.rate_in/demod.post_downsample);
 
 	while (!do_exit) {
-		safe_cond_wait(&s->hop, &s->hop_m);
-		if (s->freq_len <= 1) {
+		/* a hop asked for while still retuning is not lost */
+		pthread_mutex_lock(&s->hop_m);
+		while (!s->hop_req && !do_exit) {
+			pthread_cond_wait(&s->hop, &s->hop_m);}
+		s->hop_req = 0;
+		pthread_mutex_unlock(&s->hop_m);
+		if (do_exit || s->freq_len <= 1 || channelizer.workers) {
 			continue;}
-		/* hacky hopping */
-		s->freq_now = (s->freq_now + 1) % s->freq_len;
-		optimal_settings(s->freqs[s->freq_now], demod.rate_in);
+		/* next window, scan_check() picks its channel */
+		s->win_now = (s->win_now + 1) % s->win_len;
+		dongle.freq = s->win_tune[s->win_now];
 		rtlsdr_set_center_freq(dongle.dev, dongle.freq);
 		dongle.mute = BUFFER_DUMP;
 	}
@@ -966,6 +2319,7 @@ void dongle_init(struct dongle_state *s)
 	s->mute = 0;
 	s->direct_sampling = 0;
 	s->offset_tuning = 0;
+	s->fir_profile = NULL;
 	s->demod_target = &demod;
 }
 
@@ -986,37 +2340,110 @@ void demod_init(struct demod_state *s)
 	s->rate_out2 = -1;  // flag for disabled
 	s->mode_demod = &fm_demod;
 	s->pre_j = s->pre_r = s->now_r = s->now_j = 0;
-	s->prev_lpr_index = 0;
 	s->deemph_a = 0;
-	s->now_lpr = 0;
 	s->dc_block = 0;
 	s->dc_avg = 0;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
+	s->deemph_avg = 0;
+	s->nco_on = 0;
+	queue_init(&s->queue);
 	s->output_target = &output;
 }
 
 void demod_cleanup(struct demod_state *s)
 {
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
+	resampler_cleanup(&s->resamp);
+	queue_cleanup(&s->queue);
 }
 
 void output_init(struct output_state *s)
 {
 	s->rate = DEFAULT_SAMPLE_RATE;
-	pthread_rwlock_init(&s->rw, NULL);
-	pthread_cond_init(&s->ready, NULL);
-	pthread_mutex_init(&s->ready_m, NULL);
+	queue_init(&s->queue);
 }
 
 void output_cleanup(struct output_state *s)
 {
-	pthread_rwlock_destroy(&s->rw);
-	pthread_cond_destroy(&s->ready);
-	pthread_mutex_destroy(&s->ready_m);
+	queue_cleanup(&s->queue);
+}
+
+static int result_size(struct demod_state *d, int lp_len)
+/* longest demod output for lp_len int16 of demod input */
+{
+	int n = lp_len;  /* raw_demod keeps both I and Q */
+	int resampled;
+	if (d->rate_out2 > 0 && d->rate_out2 != d->rate_out) {
+		/* one sample per complex input, then up to rate_out2 / rate_out */
+		resampled = (int)((int64_t)(lp_len / 2) * d->rate_out2 / d->rate_out) + 2;
+		if (resampled > n) {
+			n = resampled;}
+	}
+	return n;
+}
+
+static int result_init(struct demod_state *d, int lp_len, struct arena *a)
+/* result_drop, and the resampler working on the results */
+{
+	d->result_size = result_size(d, lp_len);
+	d->result_drop = arena_alloc(a, d->result_size * sizeof(int16_t));
+	if (!d->result_drop) {
+		return -1;}
+	if (d->rate_out2 > 0 && d->rate_out2 != d->rate_out) {
+		return resampler_init(&d->resamp, d->rate_out, d->rate_out2, lp_len / 2);}
+	return 0;
+}
+
+void buffers_init(struct arena *a)
+/* size every sample buffer from the usb transfer and the decimation
+ * that follows it, then carve them all out of one arena */
+{
+	struct channelizer_state *c = &channelizer;
+	int i, r = 0, in_len, lp_len, ch_len = 0;
+	size_t total;
+	/* one int16 per usb byte, before low_pass() */
+	in_len = (int)dongle.buf_len;
+	if (!c->workers && !demod.downsample_passes) {
+		in_len = in_len / demod.downsample + 2;}
+	lp_len = in_len >> demod.downsample_passes;
+	total = queue_bytes(in_len);
+	if (c->workers) {
+		ch_len = c->seg_len / c->downsample + 2;
+		for (i = 0; i < c->workers; i++) {
+			total += queue_bytes(c->seg_len * c->worker[i].count);}
+		total += c->count * arena_round(result_size(&demod, ch_len) * sizeof(int16_t));
+	} else {
+		total += queue_bytes(result_size(&demod, lp_len));
+		total += arena_round(result_size(&demod, lp_len) * sizeof(int16_t));
+	}
+	if (arena_init(a, total) < 0 || queue_alloc(&demod.queue, in_len, a) < 0) {
+		fprintf(stderr, "Failed to allocate demod buffers.\n");
+		exit(1);
+	}
+	if (c->workers) {
+		for (i = 0; i < c->workers && r >= 0; i++) {
+			r = queue_alloc(&c->worker[i].queue, c->seg_len * c->worker[i].count, a);}
+		for (i = 0; i < c->count && r >= 0; i++) {
+			r = result_init(&c->chan[i].demod, ch_len, a);}
+	} else {
+		r = queue_alloc(&output.queue, result_size(&demod, lp_len), a);
+		if (r >= 0) {
+			r = result_init(&demod, lp_len, a);}
+	}
+	if (r == -EINVAL) {
+		fprintf(stderr, "Cannot resample %i Hz to %i Hz.\n",
+			demod.rate_out, demod.rate_out2);
+		exit(1);
+	}
+	if (r < 0) {
+		fprintf(stderr, "Failed to allocate output buffers.\n");
+		exit(1);
+	}
+	fprintf(stderr, "Sample buffers: %.1f KiB.\n", (double)a->used / 1024);
+}
+
+void queue_report(const char *name, struct buf_queue *q)
+{
+	fprintf(stderr, "%s: %u buffers, %u late, %u dropped\n",
+		name, q->queued, q->late, q->dropped);
 }
 
 void controller_init(struct controller_state *s)
@@ -1031,12 +2458,318 @@ void controller_init(struct controller_state *s)
 
 void controller_cleanup(struct controller_state *s)
 {
+	if (s->win_len) {
+		fft_cleanup(&scan.fft);
+		free(scan.power);
+		free(scan.hann);
+	}
 	pthread_cond_destroy(&s->hop);
 	pthread_mutex_destroy(&s->hop_m);
 }
 
+/* accuracy and throughput of the discriminators on a synthetic signal */
+void disc_benchmark(void)
+{
+	static const char *names[] = {"std", "fast", "lut", "poly"};
+	static struct demod_state d;
+	static int16_t lp[2 * 65536], out[65536];
+	const int n = 65536, reps = 200;
+	double ref, err, max_err, sum_err, ns;
+	int i, k, cr, cj;
+	clock_t start;
+
+	/* random phase steps over all quadrants, amplitudes as after the
+	 * 6x downsampling of -M wbfm */
+	srand(1);
+	for (i = 0; i < n; i++) {
+		double ph = 2 * M_PI * rand() / RAND_MAX;
+		double amp = 20 + 700.0 * rand() / RAND_MAX;
+		lp[2*i]   = (int16_t)(amp * cos(ph));
+		lp[2*i+1] = (int16_t)(amp * sin(ph));
+	}
+	atan_lut_init();
+
+#if defined(__AVX2__)
+	fprintf(stderr, "poly uses AVX2, ");
+#elif defined(__SSE2__)
+	fprintf(stderr, "poly uses SSE2, ");
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	fprintf(stderr, "poly uses NEON, ");
+#else
+	fprintf(stderr, "poly uses no SIMD, ");
+#endif
+	fprintf(stderr, "errors in output steps of pi/16384 rad\n");
+	fprintf(stderr, "%-6s %10s %10s %10s %10s\n",
+		"atan", "ns/sample", "Msample/s", "max err", "rms err");
+
+	for (k = 0; k < 4; k++) {
+		d.custom_atan = k;
+		d.lowpassed = lp;
+		d.lp_len = 2 * n;
+		d.result = out;
+		d.pre_r = lp[0];
+		d.pre_j = lp[1];
+		start = clock();
+		for (i = 0; i < reps; i++) {
+			fm_demod(&d);}
+		ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ((double)n * reps);
+
+		max_err = sum_err = 0;
+		for (i = 1; i < n; i++) {
+			multiply(lp[2*i], lp[2*i+1], lp[2*i-2], -lp[2*i-1], &cr, &cj);
+			ref = atan2((double)cj, (double)cr) / M_PI * (1<<14);
+			err = fabs(out[i] - ref);
+			/* +pi and -pi are the same angle */
+			if (err > (1<<14)) {
+				err = (1<<15) - err;}
+			if (err > max_err) {
+				max_err = err;}
+			sum_err += err * err;
+		}
+		fprintf(stderr, "%-6s %10.2f %10.1f %10.2f %10.3f\n", names[k],
+			ns, 1e3 / ns, max_err, sqrt(sum_err / (n - 1)));
+	}
+}
+
+void front_end_benchmark(void)
+{
+	static unsigned char usb[DEFAULT_BUF_LENGTH * 16], ref_in[DEFAULT_BUF_LENGTH * 16];
+	static int16_t ref[DEFAULT_BUF_LENGTH * 16], out[DEFAULT_BUF_LENGTH * 16];
+	static struct demod_state a, b;
+	static const int downsample[] = {1, 6, 42};
+	const int len = (int)sizeof(usb), reps = 200;
+	double ns_old, ns_new;
+	int i, k, r, ref_len = 0, out_len = 0, same;
+	clock_t start;
+
+	srand(2);
+	for (i = 0; i < len; i++) {
+		usb[i] = (unsigned char)(rand() & 0xff);}
+	fprintf(stderr, "\nfront end, %i byte buffers, rotate_90 on\n", len);
+	fprintf(stderr, "%-10s %12s %12s %6s\n",
+		"downsample", "old ns/byte", "new ns/byte", "same");
+
+	for (k = 0; k < 3; k++) {
+		memset(&a, 0, sizeof(a));
+		a.downsample = downsample[k];
+		/* downsample 1 is the -F path, no low_pass() */
+		a.downsample_passes = downsample[k] == 1;
+		b = a;
+
+		/* rotate_90() works in place, time it on a scratch copy */
+		memcpy(ref_in, usb, len);
+		start = clock();
+		for (r = 0; r < reps; r++) {
+			rotate_90(ref_in, len);
+			for (i = 0; i < len; i++) {
+				ref[i] = (int16_t)ref_in[i] - 127;}
+			ref_len = len;
+			if (!a.downsample_passes) {
+				ref_len = low_pass(&a, ref, len, ref);}
+		}
+		ns_old = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ((double)len * reps);
+
+		start = clock();
+		for (r = 0; r < reps; r++) {
+			out_len = front_end(&b, usb, len, 1, out);}
+		ns_new = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ((double)len * reps);
+
+		/* check a single pass from fresh state */
+		memset(&a, 0, sizeof(a));
+		a.downsample = downsample[k];
+		a.downsample_passes = downsample[k] == 1;
+		b = a;
+		memcpy(ref_in, usb, len);
+		rotate_90(ref_in, len);
+		for (i = 0; i < len; i++) {
+			ref[i] = (int16_t)ref_in[i] - 127;}
+		ref_len = len;
+		if (!a.downsample_passes) {
+			ref_len = low_pass(&a, ref, len, ref);}
+		out_len = front_end(&b, usb, len, 1, out);
+		same = ref_len == out_len && !memcmp(ref, out, out_len * sizeof(int16_t));
+		fprintf(stderr, "%-10i %12.3f %12.3f %6s\n", downsample[k],
+			ns_old, ns_new, same ? "yes" : "NO");
+	}
+}
+
+void cic_benchmark(void)
+{
+	static int16_t in[MAXIMUM_BUF_LENGTH], a_buf[MAXIMUM_BUF_LENGTH], b_buf[MAXIMUM_BUF_LENGTH];
+	static struct dsp_cic a, b;
+	const int len = MAXIMUM_BUF_LENGTH, reps = 100;
+	double ns_ref, ns_new;
+	int i, p, r, a_len = 0, b_len = 0, same;
+	clock_t start;
+
+	srand(3);
+	for (i = 0; i < len; i++) {
+		in[i] = (int16_t)(rand() % 255 - 127);}
+	fprintf(stderr, "\ncic decimator with -F 9, %i samples per buffer\n", len / 2);
+	fprintf(stderr, "%-10s %12s %12s %8s %6s\n",
+		"passes", "c ns/sample", "new ns/samp", "speedup", "same");
+
+	for (p = 1; p <= DSP_CIC_MAX_PASSES; p++) {
+		dsp_cic_init(&a, p, 1);
+		start = clock();
+		for (r = 0; r < reps; r++) {
+			memcpy(a_buf, in, sizeof(in));
+			a_len = dsp_cic_decimate_ref(&a, a_buf, len);
+		}
+		ns_ref = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ((double)len / 2 * reps);
+
+		dsp_cic_init(&b, p, 1);
+		start = clock();
+		for (r = 0; r < reps; r++) {
+			memcpy(b_buf, in, sizeof(in));
+			b_len = dsp_cic_decimate(&b, b_buf, len);
+		}
+		ns_new = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / ((double)len / 2 * reps);
+
+		/* both carried the same history through every rep */
+		same = a_len == b_len && !memcmp(a_buf, b_buf, a_len * sizeof(int16_t))
+		    && !memcmp(&a, &b, sizeof(a));
+		fprintf(stderr, "%-10i %12.3f %12.3f %7.2fx %6s\n", p,
+			ns_ref, ns_new, ns_ref / ns_new, same ? "yes" : "NO");
+	}
+}
+
+static double tone_level(const int16_t *y, int n, double f, int rate)
+/* amplitude of the f Hz component of y, in dB relative to 10000 */
+{
+	double re = 0, im = 0;
+	int i;
+	for (i = 0; i < n; i++) {
+		re += y[i] * cos(2 * M_PI * f * i / rate);
+		im -= y[i] * sin(2 * M_PI * f * i / rate);
+	}
+	return 20 * log10(2 * sqrt(re * re + im * im) / n / 10000 + 1e-12);
+}
+
+void resample_benchmark(void)
+{
+	static const int rates[][2] = {{170000, 48000}, {170000, 32000},
+		{24000, 48000}, {48000, 44100}};
+	static int16_t in[32768], out[65536];
+	static struct resampler r;
+	const int n = 32768, reps = 100;
+	int i, k, rep, len, total;
+	double ns, f, alias, pass;
+	clock_t start;
+
+	fprintf(stderr, "\nresampler, kaiser beta 8\n");
+	fprintf(stderr, "%-16s %6s %10s %10s %10s\n",
+		"rates", "taps", "ns/output", "1k dB", "alias dB");
+	for (k = 0; k < 4; k++) {
+		if (resampler_init(&r, rates[k][0], rates[k][1], n) < 0) {
+			continue;}
+		for (i = 0; i < n; i++) {
+			in[i] = (int16_t)(rand() % 20001 - 10000);}
+		total = 0;
+		start = clock();
+		for (rep = 0; rep < reps; rep++) {
+			total += resample(&r, in, n, out, 65536);}
+		ns = (double)(clock() - start) / CLOCKS_PER_SEC * 1e9 / total;
+		resampler_cleanup(&r);
+
+		/* passband gain */
+		resampler_init(&r, rates[k][0], rates[k][1], n);
+		for (i = 0; i < n; i++) {
+			in[i] = (int16_t)(10000 * sin(2 * M_PI * 1000 * i / rates[k][0]));}
+		len = resample(&r, in, n, out, 65536);
+		pass = tone_level(out + 256, len - 256, 1000, rates[k][1]);
+		resampler_cleanup(&r);
+
+		/* a tone that folds back into the output band */
+		resampler_init(&r, rates[k][0], rates[k][1], n);
+		if (rates[k][0] > rates[k][1]) {
+			f = 0.75 * rates[k][1];
+		} else {
+			f = 0.25 * rates[k][0];}
+		for (i = 0; i < n; i++) {
+			in[i] = (int16_t)(10000 * sin(2 * M_PI * f * i / rates[k][0]));}
+		len = resample(&r, in, n, out, 65536);
+		if (rates[k][0] > rates[k][1]) {
+			alias = tone_level(out + 256, len - 256, rates[k][1] - f, rates[k][1]);
+		} else {
+			alias = tone_level(out + 256, len - 256, rates[k][0] - f, rates[k][1]);}
+		/* below -90 dB the alias rounds away in int16 */
+		fprintf(stderr, "%6i -> %-6i %6i %10.2f %10.2f %10.1f\n", rates[k][0],
+			rates[k][1], r.taps, ns, pass, alias < -90 ? -90 : alias);
+		resampler_cleanup(&r);
+	}
+}
+
+void input_open(struct input_state *in)
+{
+	if (strcmp(in->filename, "-") == 0) { /* Read samples from stdin */
+		in->file = stdin;
+#ifdef _WIN32
+		_setmode(_fileno(in->file), _O_BINARY);
+#endif
+	} else {
+		in->file = fopen(in->filename, "rb");
+		if (!in->file) {
+			fprintf(stderr, "Failed to open %s\n", in->filename);
+			exit(1);
+		}
+	}
+	/* the recording is centred on the channel, nothing to rotate */
+	dongle.offset_tuning = 1;
+	/* no real time to keep up with, so nothing gets dropped */
+	demod.queue.block = 1;
+	output.queue.block = 1;
+}
+
+void input_report(struct input_state *in)
+{
+	double secs, per;
+	uint64_t end = in->end_ns ? in->end_ns : time_ns();
+	secs = (double)(end - in->start_ns) / 1e9;
+	per = in->samples ? 1.0 / (double)in->samples : 0.0;
+	fprintf(stderr, "Input: %llu samples in %.3f s, %.2f MS/s\n",
+		(unsigned long long)in->samples, secs,
+		secs > 0 ? (double)in->samples / secs / 1e6 : 0.0);
+	fprintf(stderr, "Per sample: front end %.2f ns, demod %.2f ns, output %.2f ns\n",
+		(double)in->front_ns * per, (double)in->demod_ns * per,
+		(double)in->output_ns * per);
+}
+
+void input_cleanup(struct input_state *in)
+{
+	if (in->file != stdin) {
+		fclose(in->file);}
+}
+
+void stats_init(struct stats_output *s)
+{
+	if (strcmp(s->filename, "-") == 0) {
+		s->file = stderr;
+	} else {
+		s->file = fopen(s->filename, "w");
+		if (!s->file) {
+			fprintf(stderr, "Failed to open %s\n", s->filename);
+			exit(1);
+		}
+	}
+	pthread_mutex_init(&s->m, NULL);
+}
+
+void stats_cleanup(struct stats_output *s)
+{
+	pthread_mutex_destroy(&s->m);
+	if (s->file != stderr) {
+		fclose(s->file);}
+}
+
 void sanity_checks(void)
 {
+	int i;
+
+	if (input.filename && controller.freq_len == 0) {
+		/* the recording was tuned already */
+		controller.freqs[controller.freq_len++] = 100000000;}
+
 	if (controller.freq_len == 0) {
 		fprintf(stderr, "Please specify a frequency.\n");
 		exit(1);
@@ -1047,11 +2780,28 @@ void sanity_checks(void)
 		exit(1);
 	}
 
-	if (controller.freq_len > 1 && demod.squelch_level == 0) {
+	if (controller.freq_len > 1 && demod.squelch_level == 0 && !channelizer.workers) {
 		fprintf(stderr, "Please specify a squelch level.  Required for scanning multiple frequencies.\n");
 		exit(1);
 	}
 
+	if (input.filename && (controller.freq_len > 1 || channelizer.workers)) {
+		fprintf(stderr, "Input files hold one capture, use a single -f and no -P.\n");
+		exit(1);
+	}
+
+	if (input.rate && input.rate % demod.rate_in) {
+		fprintf(stderr, "Input sample rate must be a multiple of %u.\n", demod.rate_in);
+		exit(1);
+	}
+
+	if (input.rate && demod.downsample_passes) {
+		i = (int)(input.rate / demod.rate_in);
+		if (i & (i - 1)) {
+			fprintf(stderr, "Input sample rate must be a power of two times %u with -F.\n", demod.rate_in);
+			exit(1);
+		}
+	}
 }
 
 int main(int argc, char **argv)
@@ -1059,16 +2809,18 @@ int main(int argc, char **argv)
 #ifndef _WIN32
 	struct sigaction sigact;
 #endif
-	int r, opt;
+	int r, opt, i;
 	int dev_given = 0;
 	int custom_ppm = 0;
     int enable_biastee = 0;
+	uint32_t dropped[2] = {0, 0};
+	uint32_t out_dropped;
 	dongle_init(&dongle);
 	demod_init(&demod);
 	output_init(&output);
 	controller_init(&controller);
 
-	while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:E:F:A:M:hT")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:s:b:l:o:t:r:p:c:E:F:A:M:P:I:S:Z:hTB")) != -1) {
 		switch (opt) {
 		case 'd':
 			dongle.dev_index = verbose_device_search(optarg);
@@ -1130,6 +2882,9 @@ int main(int argc, char **argv)
 			if (strcmp("offset",  optarg) == 0) {
 				dongle.offset_tuning = 1;}
 			break;
+		case 'c':
+			dongle.fir_profile = optarg;
+			break;
 		case 'F':
 			demod.downsample_passes = 1;  /* truthy placeholder */
 			demod.comp_fir_size = atoi(optarg);
@@ -1142,6 +2897,8 @@ int main(int argc, char **argv)
 			if (strcmp("lut",  optarg) == 0) {
 				atan_lut_init();
 				demod.custom_atan = 2;}
+			if (strcmp("poly", optarg) == 0) {
+				demod.custom_atan = 3;}
 			break;
 		case 'M':
 			if (strcmp("fm",  optarg) == 0) {
@@ -1160,7 +2917,7 @@ int main(int argc, char **argv)
 				demod.rate_in = 170000;
 				demod.rate_out = 170000;
 				demod.rate_out2 = 32000;
-				demod.custom_atan = 1;
+				demod.custom_atan = 3;
 				//demod.post_downsample = 4;
 				demod.deemph = 1;
 				demod.squelch_level = 0;}
@@ -1168,6 +2925,26 @@ int main(int argc, char **argv)
 		case 'T':
 			enable_biastee = 1;
 			break;
+		case 'P':
+			channelizer.workers = atoi(optarg);
+			if (channelizer.workers < 1) {
+				channelizer.workers = 1;}
+			break;
+		case 'I':
+			input.filename = optarg;
+			break;
+		case 'S':
+			input.rate = (uint32_t)atofs(optarg);
+			break;
+		case 'Z':
+			stats_out.filename = optarg;
+			break;
+		case 'B':
+			disc_benchmark();
+			front_end_benchmark();
+			cic_benchmark();
+			resample_benchmark();
+			exit(0);
 		case 'h':
 		default:
 			usage();
@@ -1193,19 +2970,26 @@ int main(int argc, char **argv)
 	}
 
 	ACTUAL_BUF_LENGTH = lcm_post[demod.post_downsample] * DEFAULT_BUF_LENGTH;
+	/* as close to the library default as whole post_downsample blocks go */
+	dongle.buf_len = (uint32_t)(ACTUAL_BUF_LENGTH * (MAXIMUM_BUF_LENGTH / ACTUAL_BUF_LENGTH));
 
-	if (!dev_given) {
-		dongle.dev_index = verbose_device_search("0");
-	}
+	if (input.filename) {
+		input_open(&input);
+		r = 0;
+	} else {
+		if (!dev_given) {
+			dongle.dev_index = verbose_device_search("0");
+		}
 
-	if (dongle.dev_index < 0) {
-		exit(1);
-	}
+		if (dongle.dev_index < 0) {
+			exit(1);
+		}
 
-	r = rtlsdr_open(&dongle.dev, (uint32_t)dongle.dev_index);
-	if (r < 0) {
-		fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dongle.dev_index);
-		exit(1);
+		r = rtlsdr_open(&dongle.dev, (uint32_t)dongle.dev_index);
+		if (r < 0) {
+			fprintf(stderr, "Failed to open rtlsdr device #%d.\n", dongle.dev_index);
+			exit(1);
+		}
 	}
 #ifndef _WIN32
 	sigact.sa_handler = sighandler;
@@ -1223,21 +3007,28 @@ int main(int argc, char **argv)
 		demod.deemph_a = (int)round(1.0/((1.0-exp(-1.0/(demod.rate_out * 75e-6)))));
 	}
 
-	/* Set the tuner gain */
-	if (dongle.gain == AUTO_GAIN) {
-		verbose_auto_gain(dongle.dev);
-	} else {
-		dongle.gain = nearest_gain(dongle.dev, dongle.gain);
-		verbose_gain_set(dongle.dev, dongle.gain);
-	}
+	if (dongle.dev) {
+		/* Set the tuner gain */
+		if (dongle.gain == AUTO_GAIN) {
+			verbose_auto_gain(dongle.dev);
+		} else {
+			dongle.gain = nearest_gain(dongle.dev, dongle.gain);
+			verbose_gain_set(dongle.dev, dongle.gain);
+		}
 
-	rtlsdr_set_bias_tee(dongle.dev, enable_biastee);
-	if (enable_biastee)
-		fprintf(stderr, "activated bias-T on GPIO PIN 0\n");
+		rtlsdr_set_bias_tee(dongle.dev, enable_biastee);
+		if (enable_biastee)
+			fprintf(stderr, "activated bias-T on GPIO PIN 0\n");
 
-	verbose_ppm_set(dongle.dev, dongle.ppm_error);
+		verbose_ppm_set(dongle.dev, dongle.ppm_error);
 
-	if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
+		if (dongle.fir_profile) {
+			verbose_set_fir_profile(dongle.dev, dongle.fir_profile);}
+	}
+
+	if (channelizer.workers) {
+		chan_init(&channelizer, output.filename);
+	} else if (strcmp(output.filename, "-") == 0) { /* Write samples to stdout */
 		output.file = stdout;
 #ifdef _WIN32
 		_setmode(_fileno(output.file), _O_BINARY);
@@ -1250,44 +3041,115 @@ int main(int argc, char **argv)
 		}
 	}
 
+	if (stats_out.filename) {
+		stats_init(&stats_out);}
+
+	/* set up primary channel, chan_init() has already picked the capture */
+	if (controller.wb_mode) {
+		for (i=0; i < controller.freq_len; i++) {
+			controller.freqs[i] += 16000;}
+	}
+	if (!channelizer.workers) {
+		optimal_settings(controller.freqs[0], demod.rate_in);}
+	buffers_init(&arena);
+
 	//r = rtlsdr_set_testmode(dongle.dev, 1);
 
 	/* Reset endpoint before we start reading from it (mandatory) */
-	verbose_reset_buffer(dongle.dev);
+	if (dongle.dev) {
+		verbose_reset_buffer(dongle.dev);}
 
 	pthread_create(&controller.thread, NULL, controller_thread_fn, (void *)(&controller));
 	usleep(100000);
-	pthread_create(&output.thread, NULL, output_thread_fn, (void *)(&output));
-	pthread_create(&demod.thread, NULL, demod_thread_fn, (void *)(&demod));
+	if (channelizer.workers) {
+		for (i = 0; i < channelizer.workers; i++) {
+			pthread_create(&channelizer.worker[i].thread, NULL, chan_worker_fn,
+				       (void *)(&channelizer.worker[i]));}
+		pthread_create(&channelizer.thread, NULL, chan_thread_fn, (void *)(&channelizer));
+	} else {
+		pthread_create(&output.thread, NULL, output_thread_fn, (void *)(&output));
+		pthread_create(&demod.thread, NULL, demod_thread_fn, (void *)(&demod));
+	}
 	pthread_create(&dongle.thread, NULL, dongle_thread_fn, (void *)(&dongle));
 
 	while (!do_exit) {
 		usleep(100000);
+		/* lost samples would otherwise go unnoticed */
+		out_dropped = channelizer.workers ?
+			chan_dropped(&channelizer) : output.queue.dropped;
+		if (demod.queue.dropped != dropped[0] ||
+		    out_dropped != dropped[1]) {
+			fprintf(stderr, "Dropped buffers: demod %u, output %u\n",
+				demod.queue.dropped, out_dropped);
+			dropped[0] = demod.queue.dropped;
+			dropped[1] = out_dropped;
+		}
 	}
 
-	if (do_exit) {
+	if (input.end_ns) {
+		fprintf(stderr, "\nEnd of input, exiting...\n");}
+	else if (do_exit) {
 		fprintf(stderr, "\nUser cancel, exiting...\n");}
 	else {
 		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);}
 
-	rtlsdr_cancel_async(dongle.dev);
+	if (dongle.dev) {
+		rtlsdr_cancel_async(dongle.dev);}
 	pthread_join(dongle.thread, NULL);
-	safe_cond_signal(&demod.ready, &demod.ready_m);
-	pthread_join(demod.thread, NULL);
-	safe_cond_signal(&output.ready, &output.ready_m);
-	pthread_join(output.thread, NULL);
+	queue_wake(&demod.queue);
+	if (channelizer.workers) {
+		pthread_join(channelizer.thread, NULL);
+		for (i = 0; i < channelizer.workers; i++) {
+			queue_wake(&channelizer.worker[i].queue);
+			pthread_join(channelizer.worker[i].thread, NULL);
+		}
+	} else {
+		pthread_join(demod.thread, NULL);
+		queue_wake(&output.queue);
+		pthread_join(output.thread, NULL);
+	}
 	safe_cond_signal(&controller.hop, &controller.hop_m);
 	pthread_join(controller.thread, NULL);
 
+	if (channelizer.workers) {
+		queue_report("Channelizer input", &demod.queue);
+		for (i = 0; i < channelizer.workers; i++) {
+			fprintf(stderr, "Worker %i, ", i);
+			queue_report("channels", &channelizer.worker[i].queue);
+		}
+	} else {
+		queue_report("Demod input", &demod.queue);
+		queue_report("Output", &output.queue);
+	}
+	if (input.file) {
+		input_report(&input);}
+	if (stats_out.file) {
+		if (channelizer.workers) {
+			for (i = 0; i < channelizer.count; i++) {
+				stats_report(&channelizer.chan[i].demod.stats, time_ns());}
+		} else {
+			/* the usb thread is done, take what it still holds */
+			stage_add(&stats_out.front, &dongle.front);
+			stats_report(&demod.stats, time_ns());}
+	}
+
 	//dongle_cleanup(&dongle);
 	demod_cleanup(&demod);
 	output_cleanup(&output);
 	controller_cleanup(&controller);
 
-	if (output.file != stdout) {
+	if (channelizer.workers) {
+		chan_cleanup(&channelizer);
+	} else if (output.file != stdout) {
 		fclose(output.file);}
+	arena_cleanup(&arena);
+	if (stats_out.file) {
+		stats_cleanup(&stats_out);}
 
-	rtlsdr_close(dongle.dev);
+	if (input.file) {
+		input_cleanup(&input);
+	} else {
+		rtlsdr_close(dongle.dev);}
 	return r >= 0 ? r : -r;
 }
 
@@ -65,12 +65,14 @@
 
 #include "rtl-sdr.h"
 #include "convenience/convenience.h"
+#include "dsp/dsp.h"
 
 #define MAX(x, y) (((x) > (y)) ? (x) : (y))
 
 #define DEFAULT_BUF_LENGTH		(1 * 16384)
 #define AUTO_GAIN			-100
-#define BUFFER_DUMP			(1<<12)
+/* tuner settling time after a retune */
+#define SETTLING_MS			5
 
 #define MAXIMUM_RATE			2800000
 #define MINIMUM_RATE			1000000
@@ -205,23 +207,6 @@ static void sighandler(int signum)
 #define safe_cond_signal(n, m) pthread_mutex_lock(m); pthread_cond_signal(n); pthread_mutex_unlock(m)
 #define safe_cond_wait(n, m) pthread_mutex_lock(m); pthread_cond_wait(n, m); pthread_mutex_unlock(m)
 
-/* {length, coef, coef, coef}  and scaled by 2^15
-   for now, only length 9, optimal way to get +85% bandwidth */
-#define CIC_TABLE_MAX 10
-int cic_9_tables[][10] = {
-	{0,},
-	{9, -156,  -97, 2798, -15489, 61019, -15489, 2798,  -97, -156},
-	{9, -128, -568, 5593, -24125, 74126, -24125, 5593, -568, -128},
-	{9, -129, -639, 6187, -26281, 77511, -26281, 6187, -639, -129},
-	{9, -122, -612, 6082, -26353, 77818, -26353, 6082, -612, -122},
-	{9, -120, -602, 6015, -26269, 77757, -26269, 6015, -602, -120},
-	{9, -120, -582, 5951, -26128, 77542, -26128, 5951, -582, -120},
-	{9, -119, -580, 5931, -26094, 77505, -26094, 5931, -580, -119},
-	{9, -119, -578, 5921, -26077, 77484, -26077, 5921, -578, -119},
-	{9, -119, -577, 5917, -26067, 77473, -26067, 5917, -577, -119},
-	{9, -199, -362, 5303, -25505, 77489, -25505, 5303, -362, -199},
-};
-
 #if defined(_MSC_VER) && (_MSC_VER < 1800)
 double log2(double n)
 {
@@ -474,6 +459,8 @@ void frequency_range(char *arg, double crop)
 	}
 	if (!boxcar && downsample > 1) {
 		downsample_passes = (int)log2(downsample);
+		if (downsample_passes > DSP_CIC_MAX_PASSES) {
+			downsample_passes = DSP_CIC_MAX_PASSES;}
 		downsample = 1 << downsample_passes;
 		bw_used = (int)((double)(bw_seen * downsample) / (1.0 - crop));
 	}
@@ -538,45 +525,6 @@ void frequency_range(char *arg, double crop)
 	fprintf(stderr, "Buffer size: %i bytes (%0.2fms)\n", buf_len, 1000 * 0.5 * (float)buf_len / (float)bw_used);
 }
 
-void retune(rtlsdr_dev_t *d, int freq)
-{
-	uint8_t dump[BUFFER_DUMP];
-	int n_read;
-	rtlsdr_set_center_freq(d, (uint32_t)freq);
-	/* wait for settling and flush buffer */
-	usleep(5000);
-	rtlsdr_read_sync(d, &dump, BUFFER_DUMP, &n_read);
-	if (n_read != BUFFER_DUMP) {
-		fprintf(stderr, "Error: bad retune.\n");}
-}
-
-void fifth_order(int16_t *data, int length)
-/* for half of interleaved data */
-{
-	int i;
-	int a, b, c, d, e, f;
-	a = data[0];
-	b = data[2];
-	c = data[4];
-	d = data[6];
-	e = data[8];
-	f = data[10];
-	/* a downsample should improve resolution, so don't fully shift */
-	/* ease in instead of being stateful */
-	data[0] = ((a+b)*10 + (c+d)*5 + d + f) >> 4;
-	data[2] = ((b+c)*10 + (a+d)*5 + e + f) >> 4;
-	data[4] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	for (i=12; i<length; i+=4) {
-		a = c;
-		b = d;
-		c = e;
-		d = f;
-		e = data[i-2];
-		f = data[i];
-		data[i/2] = (a + (b+e)*5 + (c+d)*10 + f) >> 4;
-	}
-}
-
 void remove_dc(int16_t *data, int length)
 /* works on interleaved data */
 {
@@ -594,128 +542,148 @@ void remove_dc(int16_t *data, int length)
 	}
 }
 
-void generic_fir(int16_t *data, int length, int *fir)
-/* Okay, not at all generic.  Assumes length 9, fix that eventually. */
+long real_conj(int16_t real, int16_t imag)
+/* real(n * conj(n)) */
+{
+	return ((long)real*(long)real + (long)imag*(long)imag);
+}
+
+void process_tune(struct tuning_state *ts)
 {
-	int d, temp, sum;
-	int hist[9] = {0,};
-	/* cheat on the beginning, let it go unfiltered */
-	for (d=0; d<18; d+=2) {
-		hist[d/2] = data[d];
-	}
-	for (d=18; d<length; d+=2) {
-		temp = data[d];
-		sum = 0;
-		sum += (hist[0] + hist[8]) * fir[1];
-		sum += (hist[1] + hist[7]) * fir[2];
-		sum += (hist[2] + hist[6]) * fir[3];
-		sum += (hist[3] + hist[5]) * fir[4];
-		sum +=            hist[4]  * fir[5];
-		data[d] = (int16_t)(sum >> 15) ;
-		hist[0] = hist[1];
-		hist[1] = hist[2];
-		hist[2] = hist[3];
-		hist[3] = hist[4];
-		hist[4] = hist[5];
-		hist[5] = hist[6];
-		hist[6] = hist[7];
-		hist[7] = hist[8];
-		hist[8] = temp;
+	int j, j2, offset, bin_e, bin_len, buf_len, ds, ds_p;
+	int32_t w;
+	struct dsp_cic cic;
+	bin_e = ts->bin_e;
+	bin_len = 1 << bin_e;
+	buf_len = ts->buf_len;
+	/* rms */
+	if (bin_len == 1) {
+		rms_power(ts);
+		return;
+	}
+	/* prep for fft */
+	for (j=0; j<buf_len; j++) {
+		fft_buf[j] = (int16_t)ts->buf8[j] - 127;
 	}
+	ds = ts->downsample;
+	ds_p = ts->downsample_passes;
+	if (boxcar && ds > 1) {
+		j=2, j2=0;
+		while (j < buf_len) {
+			fft_buf[j2]   += fft_buf[j];
+			fft_buf[j2+1] += fft_buf[j+1];
+			fft_buf[j] = 0;
+			fft_buf[j+1] = 0;
+			j += 2;
+			if (j % (ds*2) == 0) {
+				j2 += 2;}
+		}
+	} else if (ds_p) {  /* recursive */
+		/* each hop is a fresh capture, start from empty history */
+		dsp_cic_init(&cic, ds_p, comp_fir_size == 9);
+		dsp_cic_decimate(&cic, fft_buf, buf_len);
+	}
+	remove_dc(fft_buf, buf_len / ds);
+	remove_dc(fft_buf+1, (buf_len / ds) - 1);
+	/* window function and fft */
+	for (offset=0; offset<(buf_len/ds); offset+=(2*bin_len)) {
+		// todo, let rect skip this
+		for (j=0; j<bin_len; j++) {
+			w =  (int32_t)fft_buf[offset+j*2];
+			w *= (int32_t)(window_coefs[j]);
+			//w /= (int32_t)(ds);
+			fft_buf[offset+j*2]   = (int16_t)w;
+			w =  (int32_t)fft_buf[offset+j*2+1];
+			w *= (int32_t)(window_coefs[j]);
+			//w /= (int32_t)(ds);
+			fft_buf[offset+j*2+1] = (int16_t)w;
+		}
+		fix_fft(fft_buf+offset, bin_e);
+		if (!peak_hold) {
+			for (j=0; j<bin_len; j++) {
+				ts->avg[j] += real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]);
+			}
+		} else {
+			for (j=0; j<bin_len; j++) {
+				ts->avg[j] = MAX(real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]), ts->avg[j]);
+			}
+		}
+		ts->samples += ds;
+	}
+}
+
+/*
+ * The FFT of one hop runs in a worker thread while the samples of the
+ * next hop are captured, one hop is handed over at a time.
+ */
+static pthread_t fft_thread;
+static pthread_mutex_t fft_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fft_cond = PTHREAD_COND_INITIALIZER;
+static struct tuning_state *fft_pending = NULL;
+static int fft_exit = 0;
+
+static void *fft_worker(void *arg)
+{
+	struct tuning_state *ts;
+	pthread_mutex_lock(&fft_mutex);
+	while (!fft_exit) {
+		if (!fft_pending) {
+			pthread_cond_wait(&fft_cond, &fft_mutex);
+			continue;
+		}
+		ts = fft_pending;
+		pthread_mutex_unlock(&fft_mutex);
+		process_tune(ts);
+		pthread_mutex_lock(&fft_mutex);
+		fft_pending = NULL;
+		pthread_cond_broadcast(&fft_cond);
+	}
+	pthread_mutex_unlock(&fft_mutex);
+	return 0;
 }
 
-void downsample_iq(int16_t *data, int length)
+/* wait until the worker is done with ts, or with everything if NULL */
+void fft_wait(struct tuning_state *ts)
 {
-	fifth_order(data, length);
-	//remove_dc(data, length);
-	fifth_order(data+1, length-1);
-	//remove_dc(data+1, length-1);
+	pthread_mutex_lock(&fft_mutex);
+	while (fft_pending && (!ts || fft_pending == ts)) {
+		pthread_cond_wait(&fft_cond, &fft_mutex);}
+	pthread_mutex_unlock(&fft_mutex);
 }
 
-long real_conj(int16_t real, int16_t imag)
-/* real(n * conj(n)) */
+void fft_post(struct tuning_state *ts)
 {
-	return ((long)real*(long)real + (long)imag*(long)imag);
+	pthread_mutex_lock(&fft_mutex);
+	while (fft_pending) {
+		pthread_cond_wait(&fft_cond, &fft_mutex);}
+	fft_pending = ts;
+	pthread_cond_broadcast(&fft_cond);
+	pthread_mutex_unlock(&fft_mutex);
 }
 
-void scanner(void)
+int scanner(void)
+/* one pass over all hops, a failed burst ends it early */
 {
-	int i, j, j2, f, n_read, offset, bin_e, bin_len, buf_len, ds, ds_p;
-	int32_t w;
+	int i, r = 0;
 	struct tuning_state *ts;
-	bin_e = tunes[0].bin_e;
-	bin_len = 1 << bin_e;
-	buf_len = tunes[0].buf_len;
 	for (i=0; i<tune_count; i++) {
 		if (do_exit >= 2)
-			{return;}
+			{break;}
 		ts = &tunes[i];
-		f = (int)rtlsdr_get_center_freq(dev);
-		if (f != ts->freq) {
-			retune(dev, ts->freq);}
-		rtlsdr_read_sync(dev, ts->buf8, buf_len, &n_read);
-		if (n_read != buf_len) {
-			fprintf(stderr, "Error: dropped samples.\n");}
-		/* rms */
-		if (bin_len == 1) {
-			rms_power(ts);
-			continue;
-		}
-		/* prep for fft */
-		for (j=0; j<buf_len; j++) {
-			fft_buf[j] = (int16_t)ts->buf8[j] - 127;
-		}
-		ds = ts->downsample;
-		ds_p = ts->downsample_passes;
-		if (boxcar && ds > 1) {
-			j=2, j2=0;
-			while (j < buf_len) {
-				fft_buf[j2]   += fft_buf[j];
-				fft_buf[j2+1] += fft_buf[j+1];
-				fft_buf[j] = 0;
-				fft_buf[j+1] = 0;
-				j += 2;
-				if (j % (ds*2) == 0) {
-					j2 += 2;}
-			}
-		} else if (ds_p) {  /* recursive */
-			for (j=0; j < ds_p; j++) {
-				downsample_iq(fft_buf, buf_len >> j);
-			}
-			/* droop compensation */
-			if (comp_fir_size == 9 && ds_p <= CIC_TABLE_MAX) {
-				generic_fir(fft_buf, buf_len >> j, cic_9_tables[ds_p]);
-				generic_fir(fft_buf+1, (buf_len >> j)-1, cic_9_tables[ds_p]);
-			}
-		}
-		remove_dc(fft_buf, buf_len / ds);
-		remove_dc(fft_buf+1, (buf_len / ds) - 1);
-		/* window function and fft */
-		for (offset=0; offset<(buf_len/ds); offset+=(2*bin_len)) {
-			// todo, let rect skip this
-			for (j=0; j<bin_len; j++) {
-				w =  (int32_t)fft_buf[offset+j*2];
-				w *= (int32_t)(window_coefs[j]);
-				//w /= (int32_t)(ds);
-				fft_buf[offset+j*2]   = (int16_t)w;
-				w =  (int32_t)fft_buf[offset+j*2+1];
-				w *= (int32_t)(window_coefs[j]);
-				//w /= (int32_t)(ds);
-				fft_buf[offset+j*2+1] = (int16_t)w;
-			}
-			fix_fft(fft_buf+offset, bin_e);
-			if (!peak_hold) {
-				for (j=0; j<bin_len; j++) {
-					ts->avg[j] += real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]);
-				}
-			} else {
-				for (j=0; j<bin_len; j++) {
-					ts->avg[j] = MAX(real_conj(fft_buf[offset+j*2], fft_buf[offset+j*2+1]), ts->avg[j]);
-				}
-			}
-			ts->samples += ds;
+		/* the worker may still be busy with this buffer */
+		fft_wait(ts);
+		/* retune, drop stale and settling samples and read */
+		r = rtlsdr_capture_burst(dev, (uint32_t)ts->freq,
+			(uint32_t)(ts->rate / 1000 * SETTLING_MS),
+			ts->buf8, (uint32_t)(ts->buf_len / 2));
+		if (r < 0) {
+			fprintf(stderr, "Error: burst capture failed.\n");
+			break;
 		}
+		fft_post(ts);
 	}
+	fft_wait(NULL);
+	return r;
 }
 
 void csv_dbm(struct tuning_state *ts)
@@ -972,8 +940,11 @@ int main(int argc, char **argv)
 	for (i=0; i<length; i++) {
 		window_coefs[i] = (int)(256*window_fn(i, length));
 	}
+	pthread_create(&fft_thread, NULL, fft_worker, NULL);
 	while (!do_exit) {
-		scanner();
+		r = scanner();
+		if (r < 0) {
+			break;}
 		time_now = time(NULL);
 		if (time_now < next_tick) {
 			continue;}
@@ -994,11 +965,16 @@ int main(int argc, char **argv)
 	}
 
 	/* clean up */
+	pthread_mutex_lock(&fft_mutex);
+	fft_exit = 1;
+	pthread_cond_broadcast(&fft_cond);
+	pthread_mutex_unlock(&fft_mutex);
+	pthread_join(fft_thread, NULL);
 
-	if (do_exit) {
-		fprintf(stderr, "\nUser cancel, exiting...\n");}
-	else {
+	if (r < 0) {
 		fprintf(stderr, "\nLibrary error %d, exiting...\n", r);}
+	else {
+		fprintf(stderr, "\nUser cancel, exiting...\n");}
 
 	if (file != stdout) {
 		fclose(file);}
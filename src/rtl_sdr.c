@@ -35,8 +35,9 @@
  * GCD(GCD(block1, block2), 16384) bytes, which is the largest value that
  * divides both block sizes while staying ≤ 16 kB.  Keeping transfers small
  * reduces the USB pipeline depth after each hop (stale data from the previous
- * frequency), cutting per-hop settling from ~60 ms to ~16 ms.  buf_num is
- * reduced from the default 15 to 4 in 2-freq mode for the same reason.
+ * frequency), cutting per-hop settling from ~60 ms to ~16 ms.  The number
+ * of transfers follows from a latency target (-L, 16 ms by default in 2-freq
+ * mode) via rtlsdr_set_latency_target(), i.e. 4 transfers at 2.048 MSPS.
  *
  * The ADC clock runs continuously; no samples are lost on tuner switches.
  * The first ~10-25 ms of each block contains R820T PLL settling artefacts;
@@ -50,6 +51,10 @@
  *   rtl_sdr -f <freq1_hz> -f <freq2_hz> -s <rate> -g <gain> \
  *           -n <freq1_samples> -n <freq2_samples> -
  *
+ * Per-channel gain and tuner bandwidth (-g / -w given twice):
+ *   rtl_sdr -f <freq1_hz> -f <freq2_hz> -s <rate> -g <gain1> -g <gain2> \
+ *           -w <bw1_hz> -w <bw2_hz> -n <samples_per_block> -
+ *
  * Usage (standard single-frequency mode — identical to upstream rtl_sdr):
  *   rtl_sdr -f <freq_hz> [-s rate] [-g gain] [-n total_samples] <filename>
  */
@@ -91,9 +96,34 @@ static uint32_t n_samples[2] = {0, 0};       /* stored -n values (samples, not b
 static uint32_t bytes_per_block[2] = {0, 0}; /* bytes per block [freq1, freq2]; 0 = single-freq */
 static uint32_t bytes_in_block = 0;          /* bytes accumulated in the current block */
 static int current_freq_idx = 0;             /* 0 = frequency1, 1 = frequency2 */
+static uint32_t chan_gain[2] = {0, 0};       /* prepared per-channel gain, 0 = unchanged */
+static uint32_t chan_bw[2] = {0, 0};         /* prepared per-channel bandwidth, 0 = unchanged */
+
+/* automatic reconnect state */
+static int auto_reconnect = 0;
+static uint32_t discontinuities = 0;         /* reconnects seen by the callback */
+
+static uint32_t pll_failures = 0;            /* hops that failed to lock */
 
 /*
- * Retune worker thread — performs the actual rtlsdr_set_center_freq() call
+ * Tune to a channel.  With per-channel gain or bandwidth, these go out
+ * together with the frequency through rtlsdr_set_channel().
+ */
+static void tune_channel(int idx)
+{
+	uint32_t freq = idx ? frequency2 : frequency1;
+
+	if (!chan_gain[idx] && !chan_bw[idx]) {
+		verbose_set_frequency(dev, freq);
+		return;
+	}
+
+	if (rtlsdr_set_channel(dev, freq, chan_gain[idx], chan_bw[idx]) < 0)
+		fprintf(stderr, "WARNING: Failed to set channel %d.\n", idx + 1);
+}
+
+/*
+ * Retune worker thread — performs the actual rtlsdr_set_channel() call
  * outside of the libusb async callback context.
  *
  * Calling verbose_set_frequency() (which issues a synchronous USB control
@@ -106,21 +136,24 @@ static int current_freq_idx = 0;             /* 0 = frequency1, 1 = frequency2 *
 static pthread_t           retune_thread;
 static pthread_mutex_t     retune_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t      retune_cond  = PTHREAD_COND_INITIALIZER;
-static volatile uint32_t   retune_freq  = 0;  /* 0 = no pending retune */
+static volatile int        retune_idx   = -1; /* -1 = no pending retune */
 
 static void *retune_worker(void *arg)
 {
-	uint32_t freq;
+	int idx;
 	(void)arg;
 	while (!do_exit) {
 		pthread_mutex_lock(&retune_mutex);
-		while (retune_freq == 0 && !do_exit)
+		while (retune_idx < 0 && !do_exit)
 			pthread_cond_wait(&retune_cond, &retune_mutex);
-		freq = retune_freq;
-		retune_freq = 0;
+		idx = retune_idx;
+		retune_idx = -1;
 		pthread_mutex_unlock(&retune_mutex);
-		if (freq != 0)
-			verbose_set_frequency(dev, freq);
+		if (idx >= 0) {
+			tune_channel(idx);
+			/* deferred lock check, off the retune path */
+			rtlsdr_check_pll_lock(dev, &pll_failures);
+		}
 	}
 	return NULL;
 }
@@ -142,6 +175,7 @@ void usage(void)
 		"  -f is given twice: first value = freq1 (sync/FM), second = freq2 (target).\n"
 		"  -n is given once for symmetric mode, or twice for asymmetric mode.\n"
 		"  First -n matches first -f; second -n matches second -f.\n"
+		"  -g and -w may also be given twice for per-channel gain and bandwidth.\n"
 		"  The ADC clock runs continuously; no samples are dropped on tuner switches.\n"
 		"  Discard the first N settling samples of each block in the caller.\n\n"
 		"Options:\n"
@@ -149,11 +183,16 @@ void usage(void)
 		"\t-n samples                 (specify twice in 2-freq mode for asymmetric blocks)\n"
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
 		"\t[-d device_index or serial (default: 0)]\n"
-		"\t[-g gain (default: 0 for auto)]\n"
+		"\t[-g gain (default: 0 for auto, specify twice for per-channel gain)]\n"
+		"\t[-w tuner_bandwidth [Hz] (default: automatic, specify twice for per-channel)]\n"
+		"\t[-c demod FIR profile: default, wide, narrow (default: default)]\n"
 		"\t[-p ppm_error (default: 0)]\n"
 		"\t[-b output_block_size (default: auto in 2-freq mode, 16*16384 otherwise)]\n"
 		"\t[-S force sync output (default: async)]\n"
 		"\t[-D enable direct sampling (default: off)]\n"
+		"\t[-R reconnect and resume if the device is lost (default: off)]\n"
+		"\t    gives up if it is not back within 30 s\n"
+		"\t[-L latency_target_us (default: 16000 in 2-freq mode, off otherwise)]\n"
 		"\tfilename (use '-' to dump samples to stdout)\n\n");
 	exit(1);
 }
@@ -187,12 +226,65 @@ static void sighandler(int signum)
 }
 #endif
 
+/* Switch to the other channel, called at each block boundary. */
+static void next_block(void)
+{
+	bytes_in_block = 0;
+	current_freq_idx ^= 1;
+#ifndef _WIN32
+	/* Signal the retune worker thread.  Cannot call
+	 * tune_channel() here directly: it issues a
+	 * synchronous libusb control transfer from inside the
+	 * async bulk callback, which returns LIBUSB_ERROR_BUSY. */
+	pthread_mutex_lock(&retune_mutex);
+	retune_idx = current_freq_idx;
+	pthread_cond_signal(&retune_cond);
+	pthread_mutex_unlock(&retune_mutex);
+#else
+	tune_channel(current_freq_idx);
+#endif
+}
+
+/*
+ * After a reconnect the rest of the current block is lost.  Fill it with
+ * DC (127) so the block layout of the output stream stays intact and the
+ * gap is confined to a single block.
+ */
+static void pad_block(FILE *file)
+{
+	static uint8_t dc[4096];
+	uint32_t left = bytes_per_block[current_freq_idx] - bytes_in_block;
+	uint32_t n;
+
+	memset(dc, 127, sizeof(dc));
+	while (left > 0) {
+		n = left < sizeof(dc) ? left : sizeof(dc);
+		if (fwrite(dc, 1, n, file) != n)
+			break;
+		left -= n;
+	}
+
+	next_block();
+}
+
 static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 {
+	uint32_t d, gap_ms;
+
 	if (ctx) {
 		if (do_exit)
 			return;
 
+		d = auto_reconnect ? rtlsdr_get_discontinuities(dev, &gap_ms) : 0;
+		if (d != discontinuities) {
+			discontinuities = d;
+			fprintf(stderr, "Stream discontinuity, %u ms of samples "
+				"lost\n", gap_ms);
+
+			if (bytes_per_block[0] > 0 && bytes_in_block > 0)
+				pad_block((FILE*)ctx);
+		}
+
 		if ((bytes_to_read > 0) && (bytes_to_read < len)) {
 			len = bytes_to_read;
 			do_exit = 1;
@@ -226,23 +318,8 @@ static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 		 */
 		if (bytes_per_block[0] > 0) {
 			bytes_in_block += len;
-			if (bytes_in_block >= bytes_per_block[current_freq_idx]) {
-				bytes_in_block = 0;
-				current_freq_idx ^= 1;
-#ifndef _WIN32
-				/* Signal the retune worker thread.  Cannot call
-				 * verbose_set_frequency() here directly: it issues a
-				 * synchronous libusb control transfer from inside the
-				 * async bulk callback, which returns LIBUSB_ERROR_BUSY. */
-				pthread_mutex_lock(&retune_mutex);
-				retune_freq = current_freq_idx ? frequency2 : frequency1;
-				pthread_cond_signal(&retune_cond);
-				pthread_mutex_unlock(&retune_mutex);
-#else
-				verbose_set_frequency(dev,
-					current_freq_idx ? frequency2 : frequency1);
-#endif
-			}
+			if (bytes_in_block >= bytes_per_block[current_freq_idx])
+				next_block();
 		}
 	}
 }
@@ -253,9 +330,15 @@ int main(int argc, char **argv)
 	struct sigaction sigact;
 #endif
 	char *filename = NULL;
+	char *fir_profile = NULL;
 	int n_read;
 	int r, opt;
 	int gain = 0;
+	int gains[2] = {0, 0};
+	uint32_t gain_count = 0;
+	uint32_t bws[2] = {0, 0};
+	uint32_t bw_count = 0;
+	int i;
 	int ppm_error = 0;
 	int direct_sampling = 0;
 	int sync_mode = 0;
@@ -266,8 +349,11 @@ int main(int argc, char **argv)
 	int dev_given = 0;
 	uint32_t samp_rate = DEFAULT_SAMPLE_RATE;
 	uint32_t out_block_size = DEFAULT_BUF_LENGTH;
+	uint32_t latency_us = 0;
+	uint32_t buf_num = 0;
+	uint32_t buf_len;
 
-	while ((opt = getopt(argc, argv, "d:f:g:s:b:n:p:SD")) != -1) {
+	while ((opt = getopt(argc, argv, "d:f:g:s:b:n:p:w:c:L:SDR")) != -1) {
 		switch (opt) {
 		case 'd':
 			dev_index = verbose_device_search(optarg);
@@ -285,11 +371,25 @@ int main(int argc, char **argv)
 			freq_count++;
 			break;
 		case 'g':
-			gain = (int)(atof(optarg) * 10); /* tenths of a dB */
+			if (gain_count >= 2) {
+				fprintf(stderr, "Error: at most two -g arguments are supported\n");
+				usage();
+			}
+			gains[gain_count++] = (int)(atof(optarg) * 10); /* tenths of a dB */
+			break;
+		case 'w':
+			if (bw_count >= 2) {
+				fprintf(stderr, "Error: at most two -w arguments are supported\n");
+				usage();
+			}
+			bws[bw_count++] = (uint32_t)atofs(optarg);
 			break;
 		case 's':
 			samp_rate = (uint32_t)atofs(optarg);
 			break;
+		case 'c':
+			fir_profile = optarg;
+			break;
 		case 'p':
 			ppm_error = atoi(optarg);
 			break;
@@ -314,6 +414,12 @@ int main(int argc, char **argv)
 		case 'D':
 			direct_sampling = 1;
 			break;
+		case 'R':
+			auto_reconnect = 1;
+			break;
+		case 'L':
+			latency_us = (uint32_t)atof(optarg);
+			break;
 		default:
 			usage();
 			break;
@@ -333,6 +439,23 @@ int main(int argc, char **argv)
 	if (n_count >= 1)
 		bytes_to_read = n_samples[0] * 2;
 
+	/* a single -g or -w applies to both channels */
+	gain = gains[0];
+	if (gain_count < 2)
+		gains[1] = gains[0];
+	if (bw_count < 2)
+		bws[1] = bws[0];
+
+	if ((gain_count >= 2 || bw_count >= 2) && freq_count < 2) {
+		fprintf(stderr, "Error: per-channel -g and -w need two -f arguments\n");
+		usage();
+	}
+
+	if (gain_count >= 2 && (gains[0] == 0 || gains[1] == 0)) {
+		fprintf(stderr, "Error: per-channel gains must both be manual\n");
+		usage();
+	}
+
 	/*
 	 * Mode selection: two -f arguments → 2-frequency continuous alternating.
 	 *
@@ -362,24 +485,26 @@ int main(int argc, char **argv)
 			 * This preserves exact block-boundary alignment while keeping
 			 * transfers small, which reduces the number of stale samples
 			 * buffered in the USB pipeline after each frequency hop.
-			 * Combined with buf_num=4 below, the pipeline stale-data window
-			 * is ~4 * 8192 = 32768 samples (~16 ms at 2.048 MSPS), vs the
-			 * default ~15 * 8192 = ~60 ms with the librtlsdr defaults.
 			 */
 			out_block_size = gcd_u32(out_block_size, 16384);
 		}
 
+		/*
+		 * The number of transfers is derived from the latency target
+		 * by the library.  The default of 16 ms gives 4 transfers of
+		 * 16 kB at 2.048 MSPS, vs ~60 ms with the librtlsdr defaults.
+		 */
+		if (!latency_us)
+			latency_us = 16000;
+
 		fprintf(stderr,
 			"2-frequency alternating mode%s:\n"
 			"  Freq1 (sync):   %.6f MHz  block %u samples (%u bytes)\n"
 			"  Freq2 (target): %.6f MHz  block %u samples (%u bytes)\n"
-			"  USB xfer size:  %u bytes, 4 buffers (~%u ms pipeline)\n"
 			"  Running indefinitely — send SIGTERM or Ctrl-C to stop\n",
 			(bytes_per_block[0] != bytes_per_block[1]) ? " [asymmetric]" : "",
 			frequency1 / 1e6, bytes_per_block[0] / 2, bytes_per_block[0],
-			frequency2 / 1e6, bytes_per_block[1] / 2, bytes_per_block[1],
-			out_block_size,
-			(4u * (out_block_size / 2u)) * 1000u / 2048000u);
+			frequency2 / 1e6, bytes_per_block[1] / 2, bytes_per_block[1]);
 	}
 
 	if (out_block_size < MINIMAL_BUF_LENGTH ||
@@ -420,16 +545,53 @@ int main(int argc, char **argv)
 	SetConsoleCtrlHandler( (PHANDLER_ROUTINE) sighandler, TRUE );
 #endif
 
+	if (auto_reconnect)
+		rtlsdr_set_auto_reconnect(dev, 1);
+
 	/* Set direct sampling */
 	if (direct_sampling)
 		verbose_direct_sampling(dev, 2);
 
+	/* Set the demod FIR filter */
+	if (fir_profile)
+		verbose_set_fir_profile(dev, fir_profile);
+
 	/* Set the sample rate */
 	verbose_set_sample_rate(dev, samp_rate);
 
+	/* Size the USB pipeline for the latency target */
+	if (latency_us) {
+		buf_len = (freq_count >= 2 || blocksize_given) ? out_block_size : 0;
+		rtlsdr_set_latency_target(dev, latency_us);
+		r = rtlsdr_get_latency_buffers(dev, &buf_num, &buf_len);
+		if (r < 0) {
+			fprintf(stderr, "WARNING: Failed to set latency target.\n");
+			buf_num = 0;
+		} else {
+			out_block_size = buf_len;
+			fprintf(stderr, "USB xfer size: %u bytes, %u buffers "
+				"(%.1f ms pipeline)\n", buf_len, buf_num, r / 1e3);
+		}
+	}
+
+	/* Set the tuner bandwidth */
+	if (bws[0]) {
+		r = rtlsdr_set_tuner_bandwidth(dev, bws[0]);
+		if (r < 0)
+			fprintf(stderr, "WARNING: Failed to set bandwidth.\n");
+		else
+			fprintf(stderr, "Bandwidth set to %u Hz.\n", bws[0]);
+	}
+
 	/* Set the initial frequency */
 	verbose_set_frequency(dev, frequency1);
 
+#ifndef _WIN32
+	/* the retune worker verifies the PLL lock after each hop */
+	if (freq_count >= 2 && !rtlsdr_set_pll_lock_check(dev, 1))
+		fprintf(stderr, "PLL lock check deferred to the retune worker.\n");
+#endif
+
 	if (0 == gain) {
 		/* Enable automatic gain */
 		verbose_auto_gain(dev);
@@ -439,6 +601,25 @@ int main(int argc, char **argv)
 		verbose_gain_set(dev, gain);
 	}
 
+	/*
+	 * Resolve per-channel gain and bandwidth once, so each hop only
+	 * writes the tuner registers that differ between the channels.
+	 */
+	for (i = 0; i < 2 && (gain_count >= 2 || bw_count >= 2); i++) {
+		if (gain_count >= 2 &&
+		    rtlsdr_prepare_tuner_gain(dev, nearest_gain(dev, gains[i]),
+					      &chan_gain[i]) < 0)
+			fprintf(stderr, "WARNING: Failed to prepare gain.\n");
+		if (bw_count >= 2 &&
+		    rtlsdr_prepare_tuner_bandwidth(dev, bws[i], &chan_bw[i]) < 0)
+			fprintf(stderr, "WARNING: Failed to prepare bandwidth.\n");
+	}
+
+	if (gain_count >= 2 || bw_count >= 2)
+		fprintf(stderr, "Per-channel settings: freq1 %.1f dB %u Hz, "
+			"freq2 %.1f dB %u Hz\n", gains[0] / 10.0, bws[0],
+			gains[1] / 10.0, bws[1]);
+
 	verbose_ppm_set(dev, ppm_error);
 
 	if (strcmp(filename, "-") == 0) { /* Write samples to stdout */
@@ -491,7 +672,7 @@ int main(int argc, char **argv)
 			pthread_create(&retune_thread, NULL, retune_worker, NULL);
 #endif
 		r = rtlsdr_read_async(dev, rtlsdr_callback, (void *)file,
-				      freq_count >= 2 ? 4 : 0, out_block_size);
+				      buf_num, out_block_size);
 #ifndef _WIN32
 		if (freq_count >= 2) {
 			pthread_mutex_lock(&retune_mutex);
@@ -502,6 +683,10 @@ int main(int argc, char **argv)
 #endif
 	}
 
+	if (pll_failures)
+		fprintf(stderr, "WARNING: PLL failed to lock on %u hops.\n",
+			pll_failures);
+
 	if (do_exit)
 		fprintf(stderr, "\nUser cancel, exiting...\n");
 	else
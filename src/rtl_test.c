@@ -35,6 +35,7 @@
 
 #ifndef _WIN32
 #include <unistd.h>
+#include <sys/resource.h>
 #else
 #include <windows.h>
 #include "getopt/getopt.h"
@@ -53,6 +54,8 @@
 #define PPM_DURATION			10
 #define PPM_DUMP_TIME			5
 
+#define ZEROCOPY_DURATION		10
+
 struct time_generic
 /* holds all the platform specific values */
 {
@@ -71,7 +74,9 @@ struct time_generic
 static enum {
 	NO_BENCHMARK,
 	TUNER_BENCHMARK,
-	PPM_BENCHMARK
+	PPM_BENCHMARK,
+	ZEROCOPY_BENCHMARK,
+	INIT_BENCHMARK
 } test_mode = NO_BENCHMARK;
 
 static int do_exit = 0;
@@ -84,6 +89,10 @@ static uint32_t dropped_samples = 0;
 
 static unsigned int ppm_duration = PPM_DURATION;
 
+static unsigned int zerocopy_duration = ZEROCOPY_DURATION;
+static uint64_t zerocopy_bytes = 0;
+static time_t zerocopy_end;
+
 void usage(void)
 {
 	fprintf(stderr,
@@ -92,8 +101,11 @@ void usage(void)
 		"\t[-s samplerate (default: 2048000 Hz)]\n"
 		"\t[-d device_index or serial (default: 0)]\n"
 		"\t[-t enable Elonics E4000 tuner benchmark]\n"
+		"\t[-I report device open and setup times]\n"
 #ifndef _WIN32
 		"\t[-p[seconds] enable PPM error measurement (default: 10 seconds)]\n"
+		"\t[-z[seconds] compare CPU load of zero-copy and userspace buffers\n"
+		"\t\t(default: 10 seconds each)]\n"
 #endif
 		"\t[-b output_block_size (default: 16 * 16384)]\n"
 		"\t[-S force sync output (default: async)]\n");
@@ -248,13 +260,76 @@ static void ppm_test(uint32_t len)
 	nsamples = 0;
 }
 
+#ifndef _WIN32
+static void zerocopy_test(uint32_t len)
+{
+	struct time_generic now;
+
+	zerocopy_bytes += len;
+	ppm_gettime(&now);
+	if (now.tv_sec >= zerocopy_end)
+		rtlsdr_cancel_async(dev);
+}
+
+static double cpu_seconds(void)
+{
+	struct rusage ru;
+
+	getrusage(RUSAGE_SELF, &ru);
+	return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec +
+	       (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+#endif
+
 static void rtlsdr_callback(unsigned char *buf, uint32_t len, void *ctx)
 {
-	underrun_test(buf, len, 0);
+	/* restarting the stream breaks the counter sequence */
+	underrun_test(buf, len, test_mode == ZEROCOPY_BENCHMARK);
 
 	if (test_mode == PPM_BENCHMARK)
 		ppm_test(len);
+#ifndef _WIN32
+	if (test_mode == ZEROCOPY_BENCHMARK)
+		zerocopy_test(len);
+#endif
+}
+
+#ifndef _WIN32
+static int zerocopy_benchmark(uint32_t out_block_size)
+{
+	struct time_generic start;
+	double cpu, mb;
+	int on, r = 0;
+
+	for (on = 1; on >= 0 && !do_exit; on--) {
+		if (rtlsdr_set_zerocopy(dev, on) < 0) {
+			fprintf(stderr, "Zero-copy buffers not supported "
+					"by this build, skipping.\n");
+			continue;
+		}
+
+		verbose_reset_buffer(dev);
+		zerocopy_bytes = 0;
+		ppm_gettime(&start);
+		zerocopy_end = start.tv_sec + zerocopy_duration;
+
+		cpu = cpu_seconds();
+		r = rtlsdr_read_async(dev, rtlsdr_callback, NULL,
+				      0, out_block_size);
+		cpu = cpu_seconds() - cpu;
+		if (r < 0)
+			break;
+
+		mb = zerocopy_bytes / 1e6;
+		if (mb > 0)
+			fprintf(stderr, "%s buffers: %.1f MB, %.3f ms CPU per MB\n",
+				rtlsdr_get_zerocopy(dev) ? "Zero-copy" : "Userspace",
+				mb, cpu * 1000 / mb);
+	}
+
+	return r;
 }
+#endif
 
 void e4k_benchmark(void)
 {
@@ -302,6 +377,54 @@ void e4k_benchmark(void)
 		gap_start/MHZ(1), gap_end/MHZ(1));
 }
 
+static void init_report(const char *step, struct time_generic *start)
+{
+	struct time_generic now;
+	int64_t us;
+
+	ppm_gettime(&now);
+	us = (int64_t)(now.tv_sec - start->tv_sec) * 1000000 +
+	     (now.tv_nsec - start->tv_nsec) / 1000;
+	fprintf(stderr, "  %-28s %8lld us\n", step, (long long)us);
+	ppm_gettime(start);
+}
+
+void init_benchmark(void)
+{
+	uint32_t usb_us, baseband_us, probe_us, tuner_us;
+	struct time_generic start;
+
+	memset(&start, 0, sizeof(start));
+
+	rtlsdr_get_open_timing(dev, &usb_us, &baseband_us, &probe_us, &tuner_us);
+	fprintf(stderr, "Device open:\n");
+	fprintf(stderr, "  %-28s %8u us\n", "USB open", usb_us);
+	fprintf(stderr, "  %-28s %8u us\n", "baseband init", baseband_us);
+	fprintf(stderr, "  %-28s %8u us\n", "tuner probe", probe_us);
+	fprintf(stderr, "  %-28s %8u us\n", "tuner init", tuner_us);
+	fprintf(stderr, "  %-28s %8u us\n", "total",
+		usb_us + baseband_us + probe_us + tuner_us);
+
+	fprintf(stderr, "Device setup:\n");
+	ppm_gettime(&start);
+	rtlsdr_set_sample_rate(dev, samp_rate);
+	init_report("sample rate", &start);
+	rtlsdr_set_center_freq(dev, MHZ(100));
+	init_report("center frequency", &start);
+	rtlsdr_set_tuner_gain_mode(dev, 0);
+	init_report("auto gain", &start);
+	rtlsdr_set_tuner_bandwidth(dev, 0);
+	init_report("tuner bandwidth", &start);
+	rtlsdr_reset_buffer(dev);
+	init_report("reset buffer", &start);
+
+	/* leaving direct sampling initializes the tuner again */
+	rtlsdr_set_direct_sampling(dev, 2);
+	ppm_gettime(&start);
+	rtlsdr_set_direct_sampling(dev, 0);
+	init_report("tuner re-init", &start);
+}
+
 int main(int argc, char **argv)
 {
 #ifndef _WIN32
@@ -316,7 +439,7 @@ int main(int argc, char **argv)
 	int count;
 	int gains[100];
 
-	while ((opt = getopt(argc, argv, "d:s:b:tp::Sh")) != -1) {
+	while ((opt = getopt(argc, argv, "d:s:b:tIp::z::Sh")) != -1) {
 		switch (opt) {
 		case 'd':
 			dev_index = verbose_device_search(optarg);
@@ -331,11 +454,19 @@ int main(int argc, char **argv)
 		case 't':
 			test_mode = TUNER_BENCHMARK;
 			break;
+		case 'I':
+			test_mode = INIT_BENCHMARK;
+			break;
 		case 'p':
 			test_mode = PPM_BENCHMARK;
 			if (optarg)
 				ppm_duration = atoi(optarg);
 			break;
+		case 'z':
+			test_mode = ZEROCOPY_BENCHMARK;
+			if (optarg)
+				zerocopy_duration = atoi(optarg);
+			break;
 		case 'S':
 			sync_mode = 1;
 			break;
@@ -391,6 +522,11 @@ int main(int argc, char **argv)
 		fprintf(stderr, "%.1f ", gains[i] / 10.0);
 	fprintf(stderr, "\n");
 
+	if (test_mode == INIT_BENCHMARK) {
+		init_benchmark();
+		goto exit;
+	}
+
 	/* Set the sample rate */
 	verbose_set_sample_rate(dev, samp_rate);
 
@@ -414,6 +550,15 @@ int main(int argc, char **argv)
 		fprintf(stderr, "Press ^C after a few minutes.\n");
 	}
 
+#ifndef _WIN32
+	if (test_mode == ZEROCOPY_BENCHMARK) {
+		fprintf(stderr, "Measuring CPU time per MB for %u seconds "
+				"in each buffer mode...\n", zerocopy_duration);
+		r = zerocopy_benchmark(out_block_size);
+		goto exit;
+	}
+#endif
+
 	if (test_mode == NO_BENCHMARK) {
 		fprintf(stderr, "\nInfo: This tool will continuously"
 				" read from the device, and report if\n"
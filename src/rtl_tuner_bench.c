@@ -0,0 +1,444 @@
+/*
+ * rtl-sdr, turns your Realtek RTL2832 based DVB dongle into a SDR receiver
+ * rtl_tuner_bench, I2C traffic of the tuner drivers against a register model
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The tuner drivers are linked directly against this file, which provides
+ * the I2C functions librtlsdr normally supplies.  Every transaction goes
+ * to a simple register model (auto-incrementing register file per chip,
+ * with the status bits the drivers poll, such as PLL lock, always set) and
+ * is counted, so the number of I2C transactions and bytes per high-level
+ * operation can be compared before and after a driver change without any
+ * hardware.  No USB device or libusb is involved.
+ */
+
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <unistd.h>
+#else
+#include "getopt/getopt.h"
+#endif
+
+#include "rtlsdr_i2c.h"
+#include "tuner_e4k.h"
+#include "tuner_fc0012.h"
+#include "tuner_fc0013.h"
+#include "tuner_fc2580.h"
+#include "tuner_r82xx.h"
+
+#define DEFAULT_CALLS		200
+#define TUNER_CLOCK		28800000
+
+struct fake_i2c {
+	uint8_t regs[256];
+	uint8_t status[256];	/* bits always set on read */
+	uint8_t ptr;		/* register pointer for the next read */
+	int bitrev;		/* R82xx: reads start at 0, bit reversed */
+	unsigned int writes;
+	unsigned int write_bytes;
+	unsigned int reads;
+	unsigned int read_bytes;
+};
+
+struct tuner_bench;
+
+struct tuner_ops {
+	const char *name;
+	int (*init)(struct tuner_bench *t);
+	int (*set_freq)(struct tuner_bench *t, uint32_t freq);
+	int (*set_gain)(struct tuner_bench *t, int gain);
+	int (*set_bw)(struct tuner_bench *t, int bw);
+	int gains[2];	/* tenth dB, valid for this tuner */
+};
+
+struct tuner_bench {
+	const struct tuner_ops *ops;
+	struct fake_i2c i2c;
+	struct e4k_state e4k;
+	struct r82xx_config r82xx_c;
+	struct r82xx_priv r82xx_p;
+};
+
+static int verbose = 0;
+
+static uint8_t bit_reverse(uint8_t byte)
+{
+	uint8_t r = 0;
+	int i;
+
+	for (i = 0; i < 8; i++) {
+		if (byte & (1 << i))
+			r |= 0x80 >> i;
+	}
+
+	return r;
+}
+
+/* I2C functions normally provided by librtlsdr */
+
+int rtlsdr_check_dongle_model(void *dev, char *manufact_check, char *product_check)
+{
+	(void)dev; (void)manufact_check; (void)product_check;
+	return 0;
+}
+
+int rtlsdr_set_bias_tee_gpio(void *dev, int gpio, int on)
+{
+	(void)dev; (void)gpio; (void)on;
+	return 0;
+}
+
+uint32_t rtlsdr_get_tuner_clock(void *dev)
+{
+	(void)dev;
+	return TUNER_CLOCK;
+}
+
+int rtlsdr_i2c_write_fn(void *dev, uint8_t addr, uint8_t *buf, int len)
+{
+	struct fake_i2c *i2c = dev;
+	int i;
+
+	i2c->writes++;
+	i2c->write_bytes += len;
+
+	if (verbose) {
+		fprintf(stderr, "W %02x", addr);
+		for (i = 0; i < len; i++)
+			fprintf(stderr, " %02x", buf[i]);
+		fprintf(stderr, "\n");
+	}
+
+	if (len < 1)
+		return len;
+
+	i2c->ptr = buf[0];
+	for (i = 1; i < len; i++)
+		i2c->regs[(uint8_t)(buf[0] + i - 1)] = buf[i];
+
+	return len;
+}
+
+int rtlsdr_i2c_read_fn(void *dev, uint8_t addr, uint8_t *buf, int len)
+{
+	struct fake_i2c *i2c = dev;
+	uint8_t reg = i2c->bitrev ? 0 : i2c->ptr;
+	uint8_t val;
+	int i;
+
+	i2c->reads++;
+	i2c->read_bytes += len;
+
+	for (i = 0; i < len; i++, reg++) {
+		val = i2c->regs[reg] | i2c->status[reg];
+		buf[i] = i2c->bitrev ? bit_reverse(val) : val;
+	}
+
+	if (verbose) {
+		fprintf(stderr, "R %02x", addr);
+		for (i = 0; i < len; i++)
+			fprintf(stderr, " %02x", buf[i]);
+		fprintf(stderr, "\n");
+	}
+
+	return len;
+}
+
+/* tuner glue, as in librtlsdr */
+
+static int e4000_bench_init(struct tuner_bench *t)
+{
+	t->i2c.status[E4K_REG_SYNTH1] = 0x01;	/* PLL locked */
+	t->e4k.i2c_addr = E4K_I2C_ADDR;
+	t->e4k.vco.fosc = TUNER_CLOCK;
+	t->e4k.rtl_dev = &t->i2c;
+	return e4k_init(&t->e4k);
+}
+
+static int e4000_bench_set_freq(struct tuner_bench *t, uint32_t freq)
+{
+	return e4k_tune_freq(&t->e4k, freq);
+}
+
+static int e4000_bench_set_gain(struct tuner_bench *t, int gain)
+{
+	int mixgain = (gain > 340) ? 12 : 4;
+	int lnagain = gain - mixgain * 10;
+
+	if (e4k_set_lna_gain(&t->e4k, lnagain < 300 ? lnagain : 300) == -EINVAL)
+		return -1;
+
+	return e4k_mixer_gain_set(&t->e4k, mixgain) == -EINVAL ? -1 : 0;
+}
+
+static int e4000_bench_set_bw(struct tuner_bench *t, int bw)
+{
+	int r = 0;
+
+	r |= e4k_if_filter_bw_set(&t->e4k, E4K_IF_FILTER_MIX, bw);
+	r |= e4k_if_filter_bw_set(&t->e4k, E4K_IF_FILTER_RC, bw);
+	r |= e4k_if_filter_bw_set(&t->e4k, E4K_IF_FILTER_CHAN, bw);
+
+	return r;
+}
+
+static int fc0012_bench_init(struct tuner_bench *t)
+{
+	return fc0012_init(&t->i2c);
+}
+
+static int fc0012_bench_set_freq(struct tuner_bench *t, uint32_t freq)
+{
+	return fc0012_set_params(&t->i2c, freq, 6000000);
+}
+
+static int fc0012_bench_set_gain(struct tuner_bench *t, int gain)
+{
+	return fc0012_set_gain(&t->i2c, gain);
+}
+
+static int fc0013_bench_init(struct tuner_bench *t)
+{
+	return fc0013_init(&t->i2c);
+}
+
+static int fc0013_bench_set_freq(struct tuner_bench *t, uint32_t freq)
+{
+	return fc0013_set_params(&t->i2c, freq, 6000000);
+}
+
+static int fc0013_bench_set_gain(struct tuner_bench *t, int gain)
+{
+	return fc0013_set_lna_gain(&t->i2c, gain);
+}
+
+static int fc2580_bench_init(struct tuner_bench *t)
+{
+	return fc2580_Initialize(&t->i2c);
+}
+
+static int fc2580_bench_set_freq(struct tuner_bench *t, uint32_t freq)
+{
+	return fc2580_SetRfFreqHz(&t->i2c, freq);
+}
+
+static int fc2580_bench_set_bw(struct tuner_bench *t, int bw)
+{
+	(void)bw;
+	return fc2580_SetBandwidthMode(&t->i2c, 1);
+}
+
+static int r82xx_bench_init(struct tuner_bench *t, enum r82xx_chip chip)
+{
+	t->i2c.bitrev = 1;
+	t->i2c.status[0x02] = 0x40;	/* PLL locked */
+	t->i2c.status[0x04] = 0x20;	/* VCO fine tune 2 */
+	t->r82xx_c.i2c_addr = (chip == CHIP_R828D) ? R828D_I2C_ADDR : R820T_I2C_ADDR;
+	t->r82xx_c.rafael_chip = chip;
+	t->r82xx_c.xtal = TUNER_CLOCK;
+	t->r82xx_c.max_i2c_msg_len = 8;
+	t->r82xx_p.cfg = &t->r82xx_c;
+	t->r82xx_p.rtl_dev = &t->i2c;
+	return r82xx_init(&t->r82xx_p);
+}
+
+static int r820t_bench_init(struct tuner_bench *t)
+{
+	return r82xx_bench_init(t, CHIP_R820T);
+}
+
+static int r828d_bench_init(struct tuner_bench *t)
+{
+	return r82xx_bench_init(t, CHIP_R828D);
+}
+
+static int r82xx_bench_set_freq(struct tuner_bench *t, uint32_t freq)
+{
+	return r82xx_set_freq(&t->r82xx_p, freq);
+}
+
+static int r82xx_bench_set_gain(struct tuner_bench *t, int gain)
+{
+	return r82xx_set_gain(&t->r82xx_p, 1, gain);
+}
+
+static int r82xx_bench_set_bw(struct tuner_bench *t, int bw)
+{
+	int r = r82xx_set_bandwidth(&t->r82xx_p, bw, 2048000);
+
+	return r < 0 ? r : 0;
+}
+
+static const struct tuner_ops tuners[] = {
+	{ "E4000", e4000_bench_init, e4000_bench_set_freq,
+	  e4000_bench_set_gain, e4000_bench_set_bw, { 190, 420 } },
+	{ "FC0012", fc0012_bench_init, fc0012_bench_set_freq,
+	  fc0012_bench_set_gain, NULL, { -40, 179 } },
+	{ "FC0013", fc0013_bench_init, fc0013_bench_set_freq,
+	  fc0013_bench_set_gain, NULL, { 191, 402 } },
+	{ "FC2580", fc2580_bench_init, fc2580_bench_set_freq,
+	  NULL, fc2580_bench_set_bw, { 0, 0 } },
+	{ "R820T", r820t_bench_init, r82xx_bench_set_freq,
+	  r82xx_bench_set_gain, r82xx_bench_set_bw, { 197, 402 } },
+	{ "R828D", r828d_bench_init, r82xx_bench_set_freq,
+	  r82xx_bench_set_gain, r82xx_bench_set_bw, { 197, 402 } },
+};
+
+#define NUM_TUNERS	(sizeof(tuners) / sizeof(tuners[0]))
+
+enum bench_op {
+	OP_FREQ,
+	OP_GAIN,
+	OP_BW,
+};
+
+/* Run one operation with alternating arguments and print its traffic */
+static void bench_op(struct tuner_bench *t, const char *label, enum bench_op op,
+		     const int *args, int nargs, int calls)
+{
+	struct fake_i2c before = t->i2c;
+	int i, failed = 0;
+
+	for (i = 0; i < calls; i++) {
+		switch (op) {
+		case OP_FREQ:
+			failed |= t->ops->set_freq(t, (uint32_t)args[i % nargs]);
+			break;
+		case OP_GAIN:
+			failed |= t->ops->set_gain(t, args[i % nargs]);
+			break;
+		case OP_BW:
+			failed |= t->ops->set_bw(t, args[i % nargs]);
+			break;
+		}
+	}
+
+	printf("%-8s %-24s %6d %8.2f %8.2f %8.2f %8.2f%s\n", t->ops->name, label,
+	       calls,
+	       (double)(t->i2c.writes - before.writes) / calls,
+	       (double)(t->i2c.write_bytes - before.write_bytes) / calls,
+	       (double)(t->i2c.reads - before.reads) / calls,
+	       (double)(t->i2c.read_bytes - before.read_bytes) / calls,
+	       failed ? "  (errors)" : "");
+}
+
+static void bench_tuner(const struct tuner_ops *ops, int calls)
+{
+	struct tuner_bench bench;
+	struct tuner_bench *t = &bench;
+	struct fake_i2c before;
+	static const int hop[] = { 96300000, 433920000 };
+	static const int bws[] = { 2000000, 300000 };
+	int sweep[800];
+	char label[32];
+	int i, r;
+
+	for (i = 0; i < 800; i++)
+		sweep[i] = 100000000 + i * 1000000;
+
+	memset(t, 0, sizeof(*t));
+	t->ops = ops;
+
+	r = t->ops->init(t);
+	printf("%-8s %-24s %6d %8u %8u %8u %8u%s\n", t->ops->name, "init", 1,
+	       t->i2c.writes, t->i2c.write_bytes,
+	       t->i2c.reads, t->i2c.read_bytes, r < 0 ? "  (errors)" : "");
+
+	bench_op(t, "set_freq 2-freq hop", OP_FREQ, hop, 2, calls);
+	bench_op(t, "set_freq sweep 1 MHz", OP_FREQ, sweep, 800, 800);
+	if (t->ops->set_gain) {
+		sprintf(label, "set_gain %.1f/%.1f dB",
+			ops->gains[0] / 10.0, ops->gains[1] / 10.0);
+		bench_op(t, label, OP_GAIN, ops->gains, 2, calls);
+	}
+	if (t->ops->set_bw)
+		bench_op(t, "set_bw 2 MHz/300 kHz", OP_BW, bws, 2, calls);
+
+	/* as done after a reconnect or when leaving direct sampling */
+	before = t->i2c;
+	r = t->ops->init(t);
+	printf("%-8s %-24s %6d %8u %8u %8u %8u%s\n", t->ops->name, "re-init", 1,
+	       t->i2c.writes - before.writes,
+	       t->i2c.write_bytes - before.write_bytes,
+	       t->i2c.reads - before.reads,
+	       t->i2c.read_bytes - before.read_bytes, r < 0 ? "  (errors)" : "");
+}
+
+void usage(void)
+{
+	fprintf(stderr,
+		"rtl_tuner_bench, I2C traffic of the tuner drivers per operation\n"
+		"against a register model, no hardware needed\n\n"
+		"Usage:\n"
+		"\t[-t tuner (E4000, FC0012, FC0013, FC2580, R820T, R828D; default: all)]\n"
+		"\t[-n calls per operation (default: %d)]\n"
+		"\t[-v trace every I2C transaction to stderr]\n",
+		DEFAULT_CALLS);
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	const char *tuner = NULL;
+	int calls = DEFAULT_CALLS;
+	unsigned int i, found = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:n:vh")) != -1) {
+		switch (opt) {
+		case 't':
+			tuner = optarg;
+			break;
+		case 'n':
+			calls = atoi(optarg);
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+			break;
+		}
+	}
+
+	if (calls < 1)
+		usage();
+
+	printf("%-8s %-24s %6s %8s %8s %8s %8s\n", "tuner", "operation",
+	       "calls", "writes", "wbytes", "reads", "rbytes");
+	printf("%-8s %-24s %6s %8s %8s %8s %8s\n", "", "", "",
+	       "/call", "/call", "/call", "/call");
+
+	for (i = 0; i < NUM_TUNERS; i++) {
+		if (tuner && strcmp(tuner, tuners[i].name) != 0)
+			continue;
+		bench_tuner(&tuners[i], calls);
+		found++;
+	}
+
+	if (!found) {
+		fprintf(stderr, "Unknown tuner %s\n", tuner);
+		usage();
+	}
+
+	return 0;
+}
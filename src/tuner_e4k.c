@@ -70,9 +70,45 @@ static int e4k_reg_write(struct e4k_state *e4k, uint8_t reg, uint8_t val)
 	data[1] = val;
 
 	r = rtlsdr_i2c_write_fn(e4k->rtl_dev, e4k->i2c_addr, data, 2);
+
+	if (reg < E4K_NUM_REGS) {
+		if (r == 2) {
+			e4k->regs[reg] = val;
+			e4k->regs_valid[reg / 8] |= 1 << (reg % 8);
+		} else {
+			e4k->regs_valid[reg / 8] &= ~(1 << (reg % 8));
+		}
+	}
+
 	return r == 2 ? 0 : -1;
 }
 
+static int e4k_reg_known(struct e4k_state *e4k, uint8_t reg)
+{
+	return reg < E4K_NUM_REGS &&
+	       (e4k->regs_valid[reg / 8] & (1 << (reg % 8)));
+}
+
+/*! \brief Write a register unless it is known to hold the value already
+ *  \param[in] e4k reference to the tuner
+ *  \param[in] reg number of the register
+ *  \param[in] val value to be written
+ *  \returns 1 if written, 0 if unchanged, negative in case of error
+ *
+ *  Only use this for registers the chip doesn't change by itself.
+ */
+static int e4k_reg_write_cached(struct e4k_state *e4k, uint8_t reg, uint8_t val)
+{
+	int rc;
+
+	if (e4k_reg_known(e4k, reg) && e4k->regs[reg] == val)
+		return 0;
+
+	rc = e4k_reg_write(e4k, reg, val);
+
+	return rc < 0 ? rc : 1;
+}
+
 /*! \brief Read a register of the tuner chip
  *  \param[in] e4k reference to the tuner
  *  \param[in] reg number of the register
@@ -129,6 +165,30 @@ static int e4k_field_write(struct e4k_state *e4k, const struct reg_field *field,
 	return e4k_reg_set_mask(e4k, field->reg, mask, val << field->shift);
 }
 
+/*! \brief Write a given field, without reading the register if it is known
+ *  \param[in] e4k reference to the tuner
+ *  \param[in] field structure describing the field
+ *  \param[in] val value to be written
+ *  \returns 1 if written, 0 if unchanged, negative in case of error
+ */
+static int e4k_field_write_cached(struct e4k_state *e4k,
+				  const struct reg_field *field, uint8_t val)
+{
+	int rc;
+	uint8_t mask;
+
+	mask = width2mask[field->width] << field->shift;
+
+	if (!e4k_reg_known(e4k, field->reg)) {
+		rc = e4k_field_write(e4k, field, val);
+		return rc < 0 ? rc : 1;
+	}
+
+	return e4k_reg_write_cached(e4k, field->reg,
+				    (e4k->regs[field->reg] & ~mask) |
+				    ((val << field->shift) & mask));
+}
+
 /*! \brief Read a given field inside a register
  *  \param[in] e4k reference to the tuner
  *  \param[in] field structure describing the field
@@ -210,6 +270,8 @@ static int choose_rf_filter(enum e4k_band band, uint32_t freq)
 	return rc;
 }
 
+static const struct reg_field rf_filter_field = { E4K_REG_FILT1, 0, 4 };
+
 /* \brief Automatically select apropriate RF filter based on e4k state */
 int e4k_rf_filter_set(struct e4k_state *e4k)
 {
@@ -219,7 +281,9 @@ int e4k_rf_filter_set(struct e4k_state *e4k)
 	if (rc < 0)
 		return rc;
 
-	return e4k_reg_set_mask(e4k, E4K_REG_FILT1, 0xF, rc);
+	rc = e4k_field_write_cached(e4k, &rf_filter_field, rc);
+
+	return rc < 0 ? rc : 0;
 }
 
 /* Mixer Filter */
@@ -448,7 +512,23 @@ static uint32_t compute_flo(uint32_t f_osc, uint8_t z, uint16_t x, uint8_t r)
 	return fvco / r;
 }
 
-static int e4k_band_set(struct e4k_state *e4k, enum e4k_band band)
+static const struct reg_field band_field = { E4K_REG_SYNTH1, 1, 2 };
+
+static enum e4k_band e4k_band_for_flo(uint32_t flo)
+{
+	if (flo < MHZ(140))
+		return E4K_BAND_VHF2;
+	else if (flo < MHZ(350))
+		return E4K_BAND_VHF3;
+	else if (flo < MHZ(1135))
+		return E4K_BAND_UHF;
+	else
+		return E4K_BAND_L;
+}
+
+/* set the band, pll_changed tells if the PLL has just been reprogrammed */
+static int e4k_band_set(struct e4k_state *e4k, enum e4k_band band,
+			int pll_changed)
 {
 	int rc;
 
@@ -456,17 +536,20 @@ static int e4k_band_set(struct e4k_state *e4k, enum e4k_band band)
 	case E4K_BAND_VHF2:
 	case E4K_BAND_VHF3:
 	case E4K_BAND_UHF:
-		e4k_reg_write(e4k, E4K_REG_BIAS, 3);
+		e4k_reg_write_cached(e4k, E4K_REG_BIAS, 3);
 		break;
 	case E4K_BAND_L:
-		e4k_reg_write(e4k, E4K_REG_BIAS, 0);
+		e4k_reg_write_cached(e4k, E4K_REG_BIAS, 0);
 		break;
 	}
 
+	if (!pll_changed && band == e4k->band && e4k_reg_known(e4k, E4K_REG_SYNTH1))
+		return 0;
+
 	/* workaround: if we don't reset this register before writing to it,
 	 * we get a gap between 325-350 MHz */
-	rc = e4k_reg_set_mask(e4k, E4K_REG_SYNTH1, 0x06, 0);
-	rc = e4k_reg_set_mask(e4k, E4K_REG_SYNTH1, 0x06, band << 1);
+	rc = e4k_field_write_cached(e4k, &band_field, 0);
+	rc = e4k_field_write_cached(e4k, &band_field, band);
 	if (rc >= 0)
 		e4k->band = band;
 
@@ -532,36 +615,76 @@ uint32_t e4k_compute_pll_params(struct e4k_pll_params *oscp, uint32_t fosc, uint
 	return flo;
 }
 
-int e4k_tune_params(struct e4k_state *e4k, struct e4k_pll_params *p)
+/* program the PLL, band and RF filter, skipping registers that already
+ * hold the right value */
+static int e4k_tune_entry_set(struct e4k_state *e4k,
+			      const struct e4k_tune_entry *t)
 {
+	int changed = 0;
+
 	/* program R + 3phase/2phase */
-	e4k_reg_write(e4k, E4K_REG_SYNTH7, p->r_idx);
+	changed |= e4k_reg_write_cached(e4k, E4K_REG_SYNTH7, t->p.r_idx) > 0;
 	/* program Z */
-	e4k_reg_write(e4k, E4K_REG_SYNTH3, p->z);
+	changed |= e4k_reg_write_cached(e4k, E4K_REG_SYNTH3, t->p.z) > 0;
 	/* program X */
-	e4k_reg_write(e4k, E4K_REG_SYNTH4, p->x & 0xff);
-	e4k_reg_write(e4k, E4K_REG_SYNTH5, p->x >> 8);
+	changed |= e4k_reg_write_cached(e4k, E4K_REG_SYNTH4, t->p.x & 0xff) > 0;
+	changed |= e4k_reg_write_cached(e4k, E4K_REG_SYNTH5, t->p.x >> 8) > 0;
 
 	/* we're in auto calibration mode, so there's no need to trigger it */
 
-	memcpy(&e4k->vco, p, sizeof(e4k->vco));
+	memcpy(&e4k->vco, &t->p, sizeof(e4k->vco));
 
 	/* set the band */
-	if (e4k->vco.flo < MHZ(140))
-		e4k_band_set(e4k, E4K_BAND_VHF2);
-	else if (e4k->vco.flo < MHZ(350))
-		e4k_band_set(e4k, E4K_BAND_VHF3);
-	else if (e4k->vco.flo < MHZ(1135))
-		e4k_band_set(e4k, E4K_BAND_UHF);
-	else
-		e4k_band_set(e4k, E4K_BAND_L);
+	e4k_band_set(e4k, t->band, changed);
 
 	/* select and set proper RF filter */
-	e4k_rf_filter_set(e4k);
+	e4k_field_write_cached(e4k, &rf_filter_field, t->rf_filter);
 
 	return e4k->vco.flo;
 }
 
+static void e4k_tune_entry_fill(struct e4k_tune_entry *t,
+				const struct e4k_pll_params *p)
+{
+	memcpy(&t->p, p, sizeof(t->p));
+	t->band = e4k_band_for_flo(p->flo);
+	t->rf_filter = choose_rf_filter(t->band, p->flo);
+}
+
+int e4k_tune_params(struct e4k_state *e4k, struct e4k_pll_params *p)
+{
+	struct e4k_tune_entry t;
+
+	e4k_tune_entry_fill(&t, p);
+
+	return e4k_tune_entry_set(e4k, &t);
+}
+
+/* look up the settings for freq, computing them on a cache miss */
+static const struct e4k_tune_entry *e4k_tune_lookup(struct e4k_state *e4k,
+						    uint32_t freq)
+{
+	struct e4k_tune_entry *t;
+	struct e4k_pll_params p;
+	unsigned int i;
+
+	for (i = 0; i < E4K_TUNE_CACHE_SIZE; i++) {
+		t = &e4k->tune_cache[i];
+		if (t->p.fosc == e4k->vco.fosc && t->p.intended_flo == freq)
+			return t;
+	}
+
+	/* determine PLL parameters */
+	if (!e4k_compute_pll_params(&p, e4k->vco.fosc, freq))
+		return NULL;
+
+	t = &e4k->tune_cache[e4k->tune_cache_next];
+	e4k->tune_cache_next = (e4k->tune_cache_next + 1) % E4K_TUNE_CACHE_SIZE;
+	e4k_tune_entry_fill(t, &p);
+
+	return t;
+}
+
 /*! \brief High-level tuning API, just specify frquency
  *
  *  This function will compute matching PLL parameters, program them into the
@@ -574,15 +697,15 @@ int e4k_tune_params(struct e4k_state *e4k, struct e4k_pll_params *p)
 int e4k_tune_freq(struct e4k_state *e4k, uint32_t freq)
 {
 	uint32_t rc;
-	struct e4k_pll_params p;
+	const struct e4k_tune_entry *t;
 
-	/* determine PLL parameters */
-	rc = e4k_compute_pll_params(&p, e4k->vco.fosc, freq);
-	if (!rc)
+	/* determine PLL parameters, hops mostly reuse recent ones */
+	t = e4k_tune_lookup(e4k, freq);
+	if (!t)
 		return -EINVAL;
 
 	/* actually tune to those parameters */
-	rc = e4k_tune_params(e4k, &p);
+	rc = e4k_tune_entry_set(e4k, t);
 
 	/* check PLL lock */
 	rc = e4k_reg_read(e4k, E4K_REG_SYNTH1);
@@ -896,6 +1019,9 @@ int e4k_dc_offset_gen_table(struct e4k_state *e4k)
  */
 int e4k_standby(struct e4k_state *e4k, int enable)
 {
+	/* don't trust the known register values across standby */
+	memset(e4k->regs_valid, 0, sizeof(e4k->regs_valid));
+
 	e4k_reg_set_mask(e4k, E4K_REG_MASTER1, E4K_MASTER1_NORM_STBY,
 			 enable ? 0 : E4K_MASTER1_NORM_STBY);
 
@@ -923,6 +1049,9 @@ static int magic_init(struct e4k_state *e4k)
  */
 int e4k_init(struct e4k_state *e4k)
 {
+	/* the reset below clears all registers */
+	memset(e4k->regs_valid, 0, sizeof(e4k->regs_valid));
+
 	/* make a dummy i2c read or write command, will not be ACKed! */
 	e4k_reg_read(e4k, 0);
 
@@ -269,17 +269,18 @@ static bool shadow_equal(struct r82xx_priv *priv, uint8_t reg, const uint8_t *va
 	return false;
 }
 
-static int r82xx_write(struct r82xx_priv *priv, uint8_t reg, const uint8_t *val,
-		       unsigned int len)
+static void shadow_mark(struct r82xx_priv *priv, uint8_t reg, int len)
 {
-	int rc, size, pos = 0;
+	int r = reg - REG_SHADOW_START;
 
-	/* Avoid setting registers unnecessarily since it's slow */
-	if (shadow_equal(priv, reg, val, len))
-		return 0;
+	while (len-- > 0 && r < NUM_REGS)
+		priv->dirty |= 1U << r++;
+}
 
-	/* Store the shadow registers */
-	shadow_store(priv, reg, val, len);
+static int r82xx_i2c_write(struct r82xx_priv *priv, uint8_t reg,
+			   const uint8_t *val, unsigned int len)
+{
+	int rc, size, pos = 0;
 
 	do {
 		if (len > priv->cfg->max_i2c_msg_len - 1)
@@ -310,6 +311,73 @@ static int r82xx_write(struct r82xx_priv *priv, uint8_t reg, const uint8_t *val,
 	return 0;
 }
 
+static int r82xx_write(struct r82xx_priv *priv, uint8_t reg, const uint8_t *val,
+		       unsigned int len)
+{
+	/* Avoid setting registers unnecessarily since it's slow */
+	if (shadow_equal(priv, reg, val, len))
+		return 0;
+
+	/* Store the shadow registers */
+	shadow_store(priv, reg, val, len);
+
+	/* While staging, only mark them for r82xx_flush() */
+	if (priv->staging && reg >= REG_SHADOW_START) {
+		shadow_mark(priv, reg, len);
+		return 0;
+	}
+
+	return r82xx_i2c_write(priv, reg, val, len);
+}
+
+/*
+ * Write out the staged registers with as few I2C messages as possible:
+ * each message starts at the lowest dirty register and extends to the last
+ * dirty one within max_i2c_msg_len, clean registers in between are sent
+ * with their shadow value. Reads are not affected by staging, so flush
+ * before reading anything that depends on the staged registers.
+ */
+static int r82xx_flush(struct r82xx_priv *priv)
+{
+	unsigned int max = priv->cfg->max_i2c_msg_len - 1;
+	unsigned int first, last, i;
+	int rc;
+
+	while (priv->dirty) {
+		for (first = 0; !(priv->dirty & (1U << first)); first++)
+			;
+
+		last = first;
+		for (i = first + 1; i < first + max && i < NUM_REGS; i++) {
+			if (priv->dirty & (1U << i))
+				last = i;
+		}
+
+		rc = r82xx_i2c_write(priv, first + REG_SHADOW_START,
+				     &priv->regs[first], last - first + 1);
+		if (rc < 0)
+			return rc;
+
+		priv->dirty &= ~((2U << last) - 1);
+	}
+
+	return 0;
+}
+
+/* Staging nests, the outermost r82xx_stage_end() flushes */
+static void r82xx_stage_begin(struct r82xx_priv *priv)
+{
+	priv->staging++;
+}
+
+static int r82xx_stage_end(struct r82xx_priv *priv)
+{
+	if (--priv->staging > 0)
+		return 0;
+
+	return r82xx_flush(priv);
+}
+
 static int r82xx_write_reg(struct r82xx_priv *priv, uint8_t reg, uint8_t val)
 {
 	return r82xx_write(priv, reg, &val, 1);
@@ -384,20 +452,38 @@ static int r82xx_read(struct r82xx_priv *priv, uint8_t reg, uint8_t *val, int le
  * r82xx tuning logic
  */
 
+/* forget the cached mux and input state, the registers were overwritten */
+static void r82xx_invalidate_mux(struct r82xx_priv *priv)
+{
+	priv->mux_range = -1;
+	priv->notch = -1;
+	priv->input = 0xff;
+}
+
 static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 {
 	const struct r82xx_freq_range *range;
-	int rc;
-	unsigned int i;
+	const int n = ARRAY_SIZE(freq_ranges);
+	int rc, i;
 	uint8_t val;
 
-	/* Get the proper frequency range */
+	/* Get the proper frequency range, hops mostly stay in the last one */
 	freq = freq / 1000000;
-	for (i = 0; i < ARRAY_SIZE(freq_ranges) - 1; i++) {
-		if (freq < freq_ranges[i + 1].freq)
-			break;
+	i = priv->mux_range;
+	if (i < 0 || freq < freq_ranges[i].freq ||
+	    (i < n - 1 && freq >= freq_ranges[i + 1].freq)) {
+		for (i = 0; i < n - 1; i++) {
+			if (freq < freq_ranges[i + 1].freq)
+				break;
+		}
 	}
+
+	/* Nothing to do if neither the range nor the xtal cap changed */
+	if (i == priv->mux_range && priv->xtal_cap_sel == priv->mux_xtal_cap)
+		return 0;
+
 	range = &freq_ranges[i];
+	priv->mux_range = -1;
 
 	/* Open Drain */
 	rc = r82xx_write_reg_mask(priv, 0x17, range->open_d, 0x08);
@@ -440,8 +526,16 @@ static int r82xx_set_mux(struct r82xx_priv *priv, uint32_t freq)
 		return rc;
 
 	rc = r82xx_write_reg_mask(priv, 0x09, 0x00, 0x3f);
+	if (rc < 0)
+		return rc;
 
-	return rc;
+	priv->mux_range = i;
+	priv->mux_xtal_cap = priv->xtal_cap_sel;
+
+	/* the open drain bit is shared with the Blog V4 notch control */
+	priv->notch = -1;
+
+	return 0;
 }
 
 static inline uint8_t mask_reg8(uint8_t reg, uint8_t val, uint8_t mask)
@@ -449,10 +543,54 @@ static inline uint8_t mask_reg8(uint8_t reg, uint8_t val, uint8_t mask)
 	return (reg & ~mask) | (val & mask);
 }
 
-static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
+static int r82xx_pll_lock(struct r82xx_priv *priv)
 {
 	int rc, i;
 	unsigned sleep_time = 10000;
+	uint8_t data[3];
+
+	for (i = 0; i < 2; i++) {
+		/* the PLL registers must be written before checking lock */
+		rc = r82xx_flush(priv);
+		if (rc < 0)
+			return rc;
+
+//		usleep_range(sleep_time, sleep_time + 1000);
+
+		/* Check if PLL has locked */
+		rc = r82xx_read(priv, 0x00, data, 3);
+		if (rc < 0)
+			return rc;
+		if (data[2] & 0x40)
+			break;
+
+		if (!i) {
+			/* Didn't lock. Increase VCO current */
+			rc = r82xx_write_reg_mask(priv, 0x12, 0x60, 0xe0);
+			if (rc < 0)
+				return rc;
+		}
+	}
+
+	if (!(data[2] & 0x40)) {
+		fprintf(stderr, "[R82XX] PLL not locked!\n");
+		priv->has_lock = 0;
+		return 0;
+	}
+
+	priv->has_lock = 1;
+
+	/* set pll autotune = 8kHz */
+	rc = r82xx_write_reg_mask(priv, 0x1a, 0x08, 0x08);
+
+	return rc;
+}
+
+static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
+{
+	int rc;
+	/* calibration during init always waits for the lock */
+	int deferred = priv->lock_deferred && priv->init_done;
 	uint64_t vco_freq;
 	uint64_t vco_div;
 	uint32_t vco_min = 1770000; /* kHz */
@@ -499,14 +637,21 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 		mix_div = mix_div << 1;
 	}
 
-	rc = r82xx_read(priv, 0x00, data, sizeof(data));
-	if (rc < 0)
-		return rc;
+	/* the VCO band status doesn't depend on the staged mux/autotune
+	 * registers, so no flush is needed before reading it. In deferred
+	 * mode it is only read once after init. */
+	if (!deferred || priv->vco_fine_tune < 0) {
+		rc = r82xx_read(priv, 0x00, data, sizeof(data));
+		if (rc < 0)
+			return rc;
+
+		priv->vco_fine_tune = (data[4] & 0x30) >> 4;
+	}
 
 	if (priv->cfg->rafael_chip == CHIP_R828D)
 		vco_power_ref = 1;
 
-	vco_fine_tune = (data[4] & 0x30) >> 4;
+	vco_fine_tune = priv->vco_fine_tune;
 
 	if (vco_fine_tune > vco_power_ref)
 		div_num = div_num - 1;
@@ -560,36 +705,38 @@ static int r82xx_set_pll(struct r82xx_priv *priv, uint32_t freq)
 	if (rc < 0)
 		return rc;
 
-	for (i = 0; i < 2; i++) {
-//		usleep_range(sleep_time, sleep_time + 1000);
+	/* r82xx_check_lock() verifies the lock after the retune */
+	if (deferred) {
+		priv->lock_pending = 1;
+		priv->has_lock = 1;
+		return 0;
+	}
 
-		/* Check if PLL has locked */
-		rc = r82xx_read(priv, 0x00, data, 3);
-		if (rc < 0)
-			return rc;
-		if (data[2] & 0x40)
-			break;
+	return r82xx_pll_lock(priv);
+}
 
-		if (!i) {
-			/* Didn't lock. Increase VCO current */
-			rc = r82xx_write_reg_mask(priv, 0x12, 0x60, 0xe0);
-			if (rc < 0)
-				return rc;
-		}
-	}
+/*
+ * Verify the PLL lock after a retune in deferred mode, raising the VCO
+ * current if needed, like the synchronous check does. Returns 1 if locked,
+ * 0 if not, negative on I2C errors.
+ */
+int r82xx_check_lock(struct r82xx_priv *priv)
+{
+	int rc;
 
-	if (!(data[2] & 0x40)) {
-		fprintf(stderr, "[R82XX] PLL not locked!\n");
-		priv->has_lock = 0;
-		return 0;
-	}
+	if (!priv->lock_pending)
+		return priv->has_lock;
 
-	priv->has_lock = 1;
+	priv->lock_pending = 0;
 
-	/* set pll autotune = 8kHz */
-	rc = r82xx_write_reg_mask(priv, 0x1a, 0x08, 0x08);
+	rc = r82xx_pll_lock(priv);
+	if (rc < 0)
+		return rc;
 
-	return rc;
+	if (!priv->has_lock)
+		priv->lock_failures++;
+
+	return priv->has_lock;
 }
 
 static int r82xx_sysfreq_sel(struct r82xx_priv *priv, uint32_t freq,
@@ -789,15 +936,76 @@ static int r82xx_sysfreq_sel(struct r82xx_priv *priv, uint32_t freq,
 	 return 0;
 }
 
+/* Run the IF filter calibration, sets fil_cal_code */
+static int r82xx_filter_calibrate(struct r82xx_priv *priv, uint8_t hp_cor,
+				  uint32_t filt_cal_lo)
+{
+	int rc, i;
+	uint8_t data[5];
+
+	for (i = 0; i < 2; i++) {
+		/* Set filt_cap */
+		rc = r82xx_write_reg_mask(priv, 0x0b, hp_cor, 0x60);
+		if (rc < 0)
+			return rc;
+
+		/* set cali clk =on */
+		rc = r82xx_write_reg_mask(priv, 0x0f, 0x04, 0x04);
+		if (rc < 0)
+			return rc;
+
+		/* X'tal cap 0pF for PLL */
+		rc = r82xx_write_reg_mask(priv, 0x10, 0x00, 0x03);
+		if (rc < 0)
+			return rc;
+
+		rc = r82xx_set_pll(priv, filt_cal_lo * 1000);
+		if (rc < 0 || !priv->has_lock)
+			return rc;
+
+		/* Start Trigger */
+		rc = r82xx_write_reg_mask(priv, 0x0b, 0x10, 0x10);
+		if (rc < 0)
+			return rc;
+
+//			usleep_range(1000, 2000);
+
+		/* Stop Trigger */
+		rc = r82xx_write_reg_mask(priv, 0x0b, 0x00, 0x10);
+		if (rc < 0)
+			return rc;
+
+		/* set cali clk =off */
+		rc = r82xx_write_reg_mask(priv, 0x0f, 0x00, 0x04);
+		if (rc < 0)
+			return rc;
+
+		/* Check if calibration worked */
+		rc = r82xx_read(priv, 0x00, data, sizeof(data));
+		if (rc < 0)
+			return rc;
+
+		priv->fil_cal_code = data[4] & 0x0f;
+		if (priv->fil_cal_code && priv->fil_cal_code != 0x0f)
+			break;
+	}
+	/* narrowest */
+	if (priv->fil_cal_code == 0x0f)
+		priv->fil_cal_code = 0;
+
+	priv->fil_cal_valid = 1;
+
+	return 0;
+}
+
 static int r82xx_set_tv_standard(struct r82xx_priv *priv,
 				 unsigned bw,
 				 enum r82xx_tuner_type type,
 				 uint32_t delsys)
 
 {
-	int rc, i;
+	int rc, staging;
 	uint32_t if_khz, filt_cal_lo;
-	uint8_t data[5];
 	uint8_t filt_gain, img_r, filt_q, hp_cor, ext_enable, loop_through;
 	uint8_t lt_att, flt_ext_widest, polyfil_cur;
 	int need_calibration;
@@ -837,60 +1045,25 @@ static int r82xx_set_tv_standard(struct r82xx_priv *priv,
 	}
 	priv->int_freq = if_khz * 1000;
 
-	/* Check if standard changed. If so, filter calibration is needed */
-	/* as we call this function only once in rtlsdr, force calibration */
-	need_calibration = 1;
+	/*
+	 * The filter calibration result only depends on the chip, so it is
+	 * done once and reused when the tuner is initialized again.
+	 */
+	need_calibration = !priv->fil_cal_valid;
 
 	if (need_calibration) {
-		for (i = 0; i < 2; i++) {
-			/* Set filt_cap */
-			rc = r82xx_write_reg_mask(priv, 0x0b, hp_cor, 0x60);
-			if (rc < 0)
-				return rc;
-
-			/* set cali clk =on */
-			rc = r82xx_write_reg_mask(priv, 0x0f, 0x04, 0x04);
-			if (rc < 0)
-				return rc;
-
-			/* X'tal cap 0pF for PLL */
-			rc = r82xx_write_reg_mask(priv, 0x10, 0x00, 0x03);
-			if (rc < 0)
-				return rc;
-
-			rc = r82xx_set_pll(priv, filt_cal_lo * 1000);
-			if (rc < 0 || !priv->has_lock)
-				return rc;
-
-			/* Start Trigger */
-			rc = r82xx_write_reg_mask(priv, 0x0b, 0x10, 0x10);
-			if (rc < 0)
-				return rc;
-
-//			usleep_range(1000, 2000);
-
-			/* Stop Trigger */
-			rc = r82xx_write_reg_mask(priv, 0x0b, 0x00, 0x10);
-			if (rc < 0)
-				return rc;
-
-			/* set cali clk =off */
-			rc = r82xx_write_reg_mask(priv, 0x0f, 0x00, 0x04);
-			if (rc < 0)
-				return rc;
-
-			/* Check if calibration worked */
-			rc = r82xx_read(priv, 0x00, data, sizeof(data));
-			if (rc < 0)
-				return rc;
+		/* calibration needs the registers above in the chip, and each
+		 * of its steps written out immediately */
+		rc = r82xx_flush(priv);
+		if (rc < 0)
+			return rc;
 
-			priv->fil_cal_code = data[4] & 0x0f;
-			if (priv->fil_cal_code && priv->fil_cal_code != 0x0f)
-				break;
-		}
-		/* narrowest */
-		if (priv->fil_cal_code == 0x0f)
-			priv->fil_cal_code = 0;
+		staging = priv->staging;
+		priv->staging = 0;
+		rc = r82xx_filter_calibrate(priv, hp_cor, filt_cal_lo);
+		priv->staging = staging;
+		if (rc < 0 || !priv->fil_cal_valid)
+			return rc;
 	}
 
 	rc = r82xx_write_reg_mask(priv, 0x0a,
@@ -946,18 +1119,6 @@ static int r82xx_set_tv_standard(struct r82xx_priv *priv,
 	return 0;
 }
 
-static int r82xx_read_gain(struct r82xx_priv *priv)
-{
-	uint8_t data[4];
-	int rc;
-
-	rc = r82xx_read(priv, 0x00, data, sizeof(data));
-	if (rc < 0)
-		return rc;
-
-	return ((data[3] & 0x0f) << 1) + ((data[3] & 0xf0) >> 4);
-}
-
 /* measured with a Racal 6103E GSM test set at 928 MHz with -60 dBm
  * input power, for raw results see:
  * http://steve-m.de/projects/rtl-sdr/gain_measurement/r820t/
@@ -976,71 +1137,86 @@ static const int r82xx_mixer_gain_steps[]  = {
 	0, 5, 10, 10, 19, 9, 10, 25, 17, 10, 8, 16, 13, 6, 3, -8
 };
 
-int r82xx_set_gain(struct r82xx_priv *priv, int set_manual_gain, int gain)
+/* LNA and mixer steps alternate, as in the original gain search */
+static void r82xx_init_gain_steps(struct r82xx_priv *priv)
 {
-	int rc;
+	int i, total_gain = 0;
+	uint8_t mix_index = 0, lna_index = 0;
+
+	for (i = 0; i < R82XX_GAIN_STEPS; i++) {
+		if (i) {
+			if (i & 1)
+				total_gain += r82xx_lna_gain_steps[++lna_index];
+			else
+				total_gain += r82xx_mixer_gain_steps[++mix_index];
+		}
 
-	if (set_manual_gain) {
-		int i, total_gain = 0;
-		uint8_t mix_index = 0, lna_index = 0;
-		uint8_t data[4];
+		priv->gain_steps[i].gain = total_gain;
+		priv->gain_steps[i].index = (mix_index << 4) | lna_index;
+	}
+}
 
-		/* LNA auto off */
-		rc = r82xx_write_reg_mask(priv, 0x05, 0x10, 0x10);
-		if (rc < 0)
-			return rc;
+/* Get the LNA and mixer indices for a manual gain in tenth dB */
+uint8_t r82xx_gain_index(struct r82xx_priv *priv, int gain)
+{
+	int i;
 
-		 /* Mixer auto off */
-		rc = r82xx_write_reg_mask(priv, 0x07, 0, 0x10);
-		if (rc < 0)
-			return rc;
+	for (i = 0; i < R82XX_GAIN_STEPS - 1; i++) {
+		if (priv->gain_steps[i].gain >= gain)
+			break;
+	}
 
-		rc = r82xx_read(priv, 0x00, data, sizeof(data));
-		if (rc < 0)
-			return rc;
+	return priv->gain_steps[i].index;
+}
 
-		/* set fixed VGA gain for now (16.3 dB) */
-		rc = r82xx_write_reg_mask(priv, 0x0c, 0x08, 0x9f);
-		if (rc < 0)
-			return rc;
+/* Set manual gain from r82xx_gain_index(), with as few writes as possible */
+int r82xx_set_gain_index(struct r82xx_priv *priv, uint8_t index)
+{
+	int rc;
 
-		for (i = 0; i < 15; i++) {
-			if (total_gain >= gain)
-				break;
+	r82xx_stage_begin(priv);
 
-			total_gain += r82xx_lna_gain_steps[++lna_index];
+	/* LNA auto off, LNA gain */
+	rc = r82xx_write_reg_mask(priv, 0x05, 0x10 | (index & 0x0f), 0x1f);
+	if (rc < 0)
+		goto err;
 
-			if (total_gain >= gain)
-				break;
+	/* Mixer auto off, Mixer gain */
+	rc = r82xx_write_reg_mask(priv, 0x07, index >> 4, 0x1f);
+	if (rc < 0)
+		goto err;
 
-			total_gain += r82xx_mixer_gain_steps[++mix_index];
-		}
+	/* set fixed VGA gain for now (16.3 dB) */
+	rc = r82xx_write_reg_mask(priv, 0x0c, 0x08, 0x9f);
 
-		/* set LNA gain */
-		rc = r82xx_write_reg_mask(priv, 0x05, lna_index, 0x0f);
-		if (rc < 0)
-			return rc;
+err:
+	if (r82xx_stage_end(priv) < 0 && rc >= 0)
+		rc = -1;
 
-		/* set Mixer gain */
-		rc = r82xx_write_reg_mask(priv, 0x07, mix_index, 0x0f);
-		if (rc < 0)
-			return rc;
-	} else {
-		/* LNA */
-		rc = r82xx_write_reg_mask(priv, 0x05, 0, 0x10);
-		if (rc < 0)
-			return rc;
+	return rc;
+}
 
-		/* Mixer */
-		rc = r82xx_write_reg_mask(priv, 0x07, 0x10, 0x10);
-		if (rc < 0)
-			return rc;
+int r82xx_set_gain(struct r82xx_priv *priv, int set_manual_gain, int gain)
+{
+	int rc;
 
-		/* set fixed VGA gain for now (26.5 dB) */
-		rc = r82xx_write_reg_mask(priv, 0x0c, 0x0b, 0x9f);
-		if (rc < 0)
-			return rc;
-	}
+	if (set_manual_gain)
+		return r82xx_set_gain_index(priv, r82xx_gain_index(priv, gain));
+
+	/* LNA */
+	rc = r82xx_write_reg_mask(priv, 0x05, 0, 0x10);
+	if (rc < 0)
+		return rc;
+
+	/* Mixer */
+	rc = r82xx_write_reg_mask(priv, 0x07, 0x10, 0x10);
+	if (rc < 0)
+		return rc;
+
+	/* set fixed VGA gain for now (26.5 dB) */
+	rc = r82xx_write_reg_mask(priv, 0x0c, 0x0b, 0x9f);
+	if (rc < 0)
+		return rc;
 
 	return 0;
 }
@@ -1052,37 +1228,38 @@ static const int r82xx_if_low_pass_bw_table[] = {
 
 #define FILT_HP_BW1 350000
 #define FILT_HP_BW2 380000
-int r82xx_set_bandwidth(struct r82xx_priv *priv, int bw, uint32_t rate)
+/* Compute the IF filter registers for a bandwidth, without touching the tuner */
+void r82xx_prepare_bandwidth(int bw, struct r82xx_bw_setting *setting)
 {
-	int rc;
 	unsigned int i;
 	int real_bw = 0;
 	uint8_t reg_0a;
 	uint8_t reg_0b;
+	int int_freq;
 
 	if (bw > 7000000) {
 		// BW: 8 MHz
 		reg_0a = 0x10;
 		reg_0b = 0x0b;
-		priv->int_freq = 4570000;
+		int_freq = 4570000;
 	} else if (bw > 6000000) {
 		// BW: 7 MHz
 		reg_0a = 0x10;
 		reg_0b = 0x2a;
-		priv->int_freq = 4570000;
+		int_freq = 4570000;
 	} else if (bw > r82xx_if_low_pass_bw_table[0] + FILT_HP_BW1 + FILT_HP_BW2) {
 		// BW: 6 MHz
 		reg_0a = 0x10;
 		reg_0b = 0x6b;
-		priv->int_freq = 3570000;
+		int_freq = 3570000;
 	} else {
 		reg_0a = 0x00;
 		reg_0b = 0x80;
-		priv->int_freq = 2300000;
+		int_freq = 2300000;
 
 		if (bw > r82xx_if_low_pass_bw_table[0] + FILT_HP_BW1) {
 			bw -= FILT_HP_BW2;
-			priv->int_freq += FILT_HP_BW2;
+			int_freq += FILT_HP_BW2;
 			real_bw += FILT_HP_BW2;
 		} else {
 			reg_0b |= 0x20;
@@ -1090,7 +1267,7 @@ int r82xx_set_bandwidth(struct r82xx_priv *priv, int bw, uint32_t rate)
 
 		if (bw > r82xx_if_low_pass_bw_table[0]) {
 			bw -= FILT_HP_BW1;
-			priv->int_freq += FILT_HP_BW1;
+			int_freq += FILT_HP_BW1;
 			real_bw += FILT_HP_BW1;
 		} else {
 			reg_0b |= 0x40;
@@ -1105,26 +1282,48 @@ int r82xx_set_bandwidth(struct r82xx_priv *priv, int bw, uint32_t rate)
 		reg_0b |= 15 - i;
 		real_bw += r82xx_if_low_pass_bw_table[i];
 
-		priv->int_freq -= real_bw / 2;
+		int_freq -= real_bw / 2;
 	}
 
-	rc = r82xx_write_reg_mask(priv, 0x0a, reg_0a, 0x10);
+	setting->reg_0a = reg_0a;
+	setting->reg_0b = reg_0b;
+	setting->int_freq = int_freq;
+}
+
+/* Apply a setting from r82xx_prepare_bandwidth(), returns the IF frequency */
+int r82xx_set_prepared_bandwidth(struct r82xx_priv *priv,
+				 const struct r82xx_bw_setting *setting)
+{
+	int rc;
+
+	priv->int_freq = setting->int_freq;
+
+	rc = r82xx_write_reg_mask(priv, 0x0a, setting->reg_0a, 0x10);
 	if (rc < 0)
 		return rc;
 
-	rc = r82xx_write_reg_mask(priv, 0x0b, reg_0b, 0xef);
+	rc = r82xx_write_reg_mask(priv, 0x0b, setting->reg_0b, 0xef);
 	if (rc < 0)
 		return rc;
 
 	return priv->int_freq;
 }
+
+int r82xx_set_bandwidth(struct r82xx_priv *priv, int bw, uint32_t rate)
+{
+	struct r82xx_bw_setting setting;
+
+	r82xx_prepare_bandwidth(bw, &setting);
+
+	return r82xx_set_prepared_bandwidth(priv, &setting);
+}
 #undef FILT_HP_BW1
 #undef FILT_HP_BW2
 
 int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 {
 	int rc = -1;
-	int is_rtlsdr_blog_v4;
+	int is_rtlsdr_blog_v4 = priv->cfg->blog_v4;
 	uint32_t upconvert_freq;
 	uint32_t lo_freq;
 	uint8_t air_cable1_in;
@@ -1134,14 +1333,16 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 	uint8_t cable_1_in;
 	uint8_t air_in;
 
-	is_rtlsdr_blog_v4 = rtlsdr_check_dongle_model(priv->rtl_dev, "RTLSDRBlog", "Blog V4");
-
 	/* if it's an RTL-SDR Blog V4, automatically upconvert by 28.8 MHz if we tune to HF
 	 * so that we don't need to manually set any upconvert offset in the SDR software */
 	upconvert_freq = is_rtlsdr_blog_v4 ? ((freq < MHZ(28.8)) ? (freq + MHZ(28.8)) : freq) : freq;
 
 	lo_freq = upconvert_freq + priv->int_freq;
 
+	/* collect the register changes of this retune, the PLL lock check and
+	 * r82xx_stage_end() write them out in as few messages as possible */
+	r82xx_stage_begin(priv);
+
 	rc = r82xx_set_mux(priv, lo_freq);
 	if (rc < 0)
 		goto err;
@@ -1155,10 +1356,14 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 		 * when tuned within the notch band and ON when tuned outside the notch band.
 		 */
 		open_d = (freq <= MHZ(2.2) || (freq >= MHZ(85) && freq <= MHZ(112)) || (freq >= MHZ(172) && freq <= MHZ(242))) ? 0x00 : 0x08;
-		rc = r82xx_write_reg_mask(priv, 0x17, open_d, 0x08);
+		if (open_d != priv->notch) {
+			rc = r82xx_write_reg_mask(priv, 0x17, open_d, 0x08);
 
-		if (rc < 0)
-			return rc;
+			if (rc < 0)
+				goto err;
+
+			priv->notch = open_d;
+		}
 
 		/* select tuner band based on frequency and only switch if there is a band change
 		 *(to avoid excessive register writes when tuning rapidly)
@@ -1213,8 +1418,15 @@ int r82xx_set_freq(struct r82xx_priv *priv, uint32_t freq)
 	}
 
 err:
-	if (rc < 0)
+	/* write out what was staged, even after an error, so the shadow
+	 * registers match the chip again */
+	if (r82xx_stage_end(priv) < 0 && rc >= 0)
+		rc = -1;
+
+	if (rc < 0) {
+		r82xx_invalidate_mux(priv);
 		fprintf(stderr, "%s: failed=%d\n", __FUNCTION__, rc);
+	}
 	return rc;
 }
 
@@ -1222,6 +1434,32 @@ err:
  * r82xx standby logic
  */
 
+/*
+ * Retune with an optional prepared bandwidth and manual gain index (< 0 to
+ * keep the current gain), all register changes go out in one flush.
+ */
+int r82xx_set_channel(struct r82xx_priv *priv, uint32_t freq,
+		      const struct r82xx_bw_setting *bw, int gain_index)
+{
+	int rc = 0;
+
+	r82xx_stage_begin(priv);
+
+	if (bw)
+		rc = r82xx_set_prepared_bandwidth(priv, bw);
+
+	if (rc >= 0 && gain_index >= 0)
+		rc = r82xx_set_gain_index(priv, gain_index);
+
+	if (rc >= 0)
+		rc = r82xx_set_freq(priv, freq);
+
+	if (r82xx_stage_end(priv) < 0 && rc >= 0)
+		rc = -1;
+
+	return rc;
+}
+
 int r82xx_standby(struct r82xx_priv *priv)
 {
 	int rc;
@@ -1264,6 +1502,9 @@ int r82xx_standby(struct r82xx_priv *priv)
 
 	/* Force initial calibration */
 	priv->type = -1;
+	r82xx_invalidate_mux(priv);
+	priv->vco_fine_tune = -1;
+	priv->lock_pending = 0;
 
 	return rc;
 }
@@ -1337,8 +1578,19 @@ int r82xx_init(struct r82xx_priv *priv)
 
 	/* TODO: R828D might need r82xx_xtal_check() */
 	priv->xtal_cap_sel = XTAL_HIGH_CAP_0P;
+	r82xx_init_gain_steps(priv);
+	priv->vco_fine_tune = -1;
+	priv->lock_pending = 0;
+	/* r82xx_set_pll() waits for the lock until init is done, again on a
+	 * re-init after a reconnect */
+	priv->init_done = 0;
 
-	/* Initialize registers */
+	/*
+	 * Initialize registers.  Everything up to the filter calibration and
+	 * everything after it is collected and written out in one pass, so
+	 * a re-init with a known calibration is a single register file write.
+	 */
+	r82xx_stage_begin(priv);
 	memset(priv->regs, 0, NUM_REGS);
 	rc = r82xx_write(priv, 0x05,
 			 r82xx_init_array, sizeof(r82xx_init_array));
@@ -1349,11 +1601,19 @@ int r82xx_init(struct r82xx_priv *priv)
 
 	rc = r82xx_sysfreq_sel(priv, 0, TUNER_DIGITAL_TV, SYS_DVBT);
 
-	priv->init_done = 1;
-
 err:
-	if (rc < 0)
+	if (r82xx_stage_end(priv) < 0 && rc >= 0)
+		rc = -1;
+
+	if (rc < 0) {
 		fprintf(stderr, "%s: failed=%d\n", __FUNCTION__, rc);
+		return rc;
+	}
+
+	/* the calibration above left the mux registers in an unknown state */
+	r82xx_invalidate_mux(priv);
+	priv->init_done = 1;
+
 	return rc;
 }
 